@@ -9,6 +9,7 @@
 #include <linux/module.h>
 #include <linux/device.h>
 #include <linux/kernel.h>
+#include <linux/delay.h>
 #include <linux/dmaengine.h>
 #include <linux/err.h>
 #include <linux/interrupt.h>
@@ -306,6 +307,45 @@ static int dw_edma_device_terminate_all(struct dma_chan *dchan)
 	return err;
 }
 
+/*
+ * Wait for the engine to stop after dw_edma_device_terminate_all(): the chunk
+ * in progress is not interrupted, but no other one is started afterwards.
+ */
+static void dw_edma_done_interrupt(struct dw_edma_chan *chan);
+static void dw_edma_abort_interrupt(struct dw_edma_chan *chan);
+
+static void dw_edma_device_synchronize(struct dma_chan *dchan)
+{
+	struct dw_edma_chan *chan = dchan2dw_edma_chan(dchan);
+	unsigned long timeout = jiffies + msecs_to_jiffies(EDMA_SYNC_TIMEOUT_MS);
+
+	while (dw_edma_core_ch_status(chan) == DMA_IN_PROGRESS) {
+		if (time_after(jiffies, timeout)) {
+			dev_warn(chan2dev(chan), "channel still running after terminate\n");
+			break;
+		}
+		usleep_range(50, 100);
+	}
+
+	/*
+	 * The interrupt handler skips polled channels: process their done or
+	 * abort status here, else the stop request and the stopped descriptor
+	 * stay pending and the channel is never started again.
+	 */
+	while (chan->polled && chan->request == EDMA_REQ_STOP) {
+		if (dw_edma_core_ch_poll(chan, dw_edma_done_interrupt,
+					 dw_edma_abort_interrupt))
+			continue;
+		if (time_after(jiffies, timeout)) {
+			dev_warn(chan2dev(chan), "polled channel not stopped after terminate\n");
+			break;
+		}
+		usleep_range(50, 100);
+	}
+
+	vchan_synchronize(&chan->vc);
+}
+
 static void dw_edma_device_issue_pending(struct dma_chan *dchan)
 {
 	struct dw_edma_chan *chan = dchan2dw_edma_chan(dchan);
@@ -620,6 +660,7 @@ static void dw_edma_done_interrupt(struct dw_edma_chan *chan)
 
 		case EDMA_REQ_STOP:
 			list_del(&vd->node);
+			vd->tx_result.result = DMA_TRANS_ABORTED;
 			vchan_cookie_complete(vd);
 			chan->request = EDMA_REQ_NONE;
 			chan->status = EDMA_ST_IDLE;
@@ -646,6 +687,7 @@ static void dw_edma_abort_interrupt(struct dw_edma_chan *chan)
 	vd = vchan_next_desc(&chan->vc);
 	if (vd) {
 		list_del(&vd->node);
+		vd->tx_result.result = DMA_TRANS_ABORTED;
 		vchan_cookie_complete(vd);
 	}
 	spin_unlock_irqrestore(&chan->vc.lock, flags);
@@ -802,6 +844,7 @@ static int dw_edma_channel_setup(struct dw_edma *dw, u32 wr_alloc, u32 rd_alloc)
 	dma->device_pause = dw_edma_device_pause;
 	dma->device_resume = dw_edma_device_resume;
 	dma->device_terminate_all = dw_edma_device_terminate_all;
+	dma->device_synchronize = dw_edma_device_synchronize;
 	dma->device_issue_pending = dw_edma_device_issue_pending;
 	dma->device_tx_status = dw_edma_device_tx_status;
 	dma->device_prep_slave_sg = dw_edma_device_prep_slave_sg;
@@ -1012,6 +1055,39 @@ int akida_dw_edma_remove(struct dw_edma_chip *chip)
 }
 EXPORT_SYMBOL_GPL(akida_dw_edma_remove);
 
+/*
+ * Polled channels: the done and abort interrupts of the channel are masked
+ * from the next transfer started on it, and its transfers are completed by
+ * akida_dw_edma_poll() instead of the interrupt handler.
+ * The mode must only be changed while the channel is idle.
+ */
+void akida_dw_edma_set_polled(struct dma_chan *dchan, bool polled)
+{
+	struct dw_edma_chan *chan = dchan2dw_edma_chan(dchan);
+	unsigned long flags;
+
+	spin_lock_irqsave(&chan->vc.lock, flags);
+	chan->polled = polled;
+	spin_unlock_irqrestore(&chan->vc.lock, flags);
+}
+EXPORT_SYMBOL_GPL(akida_dw_edma_set_polled);
+
+/*
+ * Check the done and abort status of a polled channel and process them as
+ * the interrupt handler would. The cookie of a completed transfer is
+ * completed before returning, its callback is still run from the channel
+ * tasklet.
+ * Return true if a done or abort status was processed.
+ */
+bool akida_dw_edma_poll(struct dma_chan *dchan)
+{
+	struct dw_edma_chan *chan = dchan2dw_edma_chan(dchan);
+
+	return dw_edma_core_ch_poll(chan, dw_edma_done_interrupt,
+				    dw_edma_abort_interrupt);
+}
+EXPORT_SYMBOL_GPL(akida_dw_edma_poll);
+
 MODULE_LICENSE("GPL v2");
 MODULE_DESCRIPTION("Synopsys DesignWare eDMA controller core driver");
 MODULE_AUTHOR("Gustavo Pimentel <gustavo.pimentel@synopsys.com>");
@@ -15,6 +15,7 @@
 #include "virt-dma.h"
 
 #define EDMA_LL_SZ					24
+#define EDMA_SYNC_TIMEOUT_MS				1000
 
 enum dw_edma_dir {
 	EDMA_DIR_WRITE = 0,
@@ -84,6 +85,7 @@ struct dw_edma_chan {
 	enum dw_edma_request		request;
 	enum dw_edma_status		status;
 	u8				configured;
+	u8				polled;		/* Done/abort interrupts masked */
 
 	struct dma_slave_config		config;
 };
@@ -123,6 +125,8 @@ struct dw_edma_core_ops {
 	enum dma_status (*ch_status)(struct dw_edma_chan *chan);
 	irqreturn_t (*handle_int)(struct dw_edma_irq *dw_irq, enum dw_edma_dir dir,
 				  dw_edma_handler_t done, dw_edma_handler_t abort);
+	bool (*ch_poll)(struct dw_edma_chan *chan,
+			dw_edma_handler_t done, dw_edma_handler_t abort);
 	void (*start)(struct dw_edma_chunk *chunk, bool first);
 	void (*ch_config)(struct dw_edma_chan *chan);
 	void (*debugfs_on)(struct dw_edma *dw);
@@ -188,6 +192,13 @@ dw_edma_core_handle_int(struct dw_edma_irq *dw_irq, enum dw_edma_dir dir,
 	return dw_irq->dw->core->handle_int(dw_irq, dir, done, abort);
 }
 
+static inline bool
+dw_edma_core_ch_poll(struct dw_edma_chan *chan,
+		     dw_edma_handler_t done, dw_edma_handler_t abort)
+{
+	return chan->dw->core->ch_poll(chan, done, abort);
+}
+
 static inline
 void dw_edma_core_start(struct dw_edma *dw, struct dw_edma_chunk *chunk, bool first)
 {
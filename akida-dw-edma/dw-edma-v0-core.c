@@ -264,6 +264,10 @@ dw_edma_v0_core_handle_int(struct dw_edma_irq *dw_irq, enum dw_edma_dir dir,
 	for_each_set_bit(pos, &val, total) {
 		chan = &dw->chan[pos + off];
 
+		/* Polled channels are handled by dw_edma_v0_core_ch_poll() */
+		if (chan->polled)
+			continue;
+
 		dw_edma_v0_core_clear_done_int(chan);
 		done(chan);
 
@@ -275,6 +279,9 @@ dw_edma_v0_core_handle_int(struct dw_edma_irq *dw_irq, enum dw_edma_dir dir,
 	for_each_set_bit(pos, &val, total) {
 		chan = &dw->chan[pos + off];
 
+		if (chan->polled)
+			continue;
+
 		dw_edma_v0_core_clear_abort_int(chan);
 		abort(chan);
 
@@ -284,12 +291,37 @@ dw_edma_v0_core_handle_int(struct dw_edma_irq *dw_irq, enum dw_edma_dir dir,
 	return ret;
 }
 
+static bool dw_edma_v0_core_ch_poll(struct dw_edma_chan *chan,
+				    dw_edma_handler_t done,
+				    dw_edma_handler_t abort)
+{
+	struct dw_edma *dw = chan->dw;
+	bool handled = false;
+
+	if (dw_edma_v0_core_status_done_int(dw, chan->dir) & BIT(chan->id)) {
+		dw_edma_v0_core_clear_done_int(chan);
+		done(chan);
+
+		handled = true;
+	}
+
+	if (dw_edma_v0_core_status_abort_int(dw, chan->dir) & BIT(chan->id)) {
+		dw_edma_v0_core_clear_abort_int(chan);
+		abort(chan);
+
+		handled = true;
+	}
+
+	return handled;
+}
+
 static void dw_edma_v0_write_ll_data(struct dw_edma_chunk *chunk, int i,
 				     u32 control, u32 size, u64 sar, u64 dar)
 {
 	ptrdiff_t ofs = i * sizeof(struct dw_edma_v0_lli);
 
-	if (chunk->chan->dw->chip->flags & DW_EDMA_CHIP_LOCAL) {
+	if (chunk->chan->dw->chip->flags &
+	    (DW_EDMA_CHIP_LOCAL | DW_EDMA_CHIP_LL_MEM)) {
 		struct dw_edma_v0_lli *lli = chunk->ll_region.vaddr.mem + ofs;
 
 		lli->transfer_size = size;
@@ -314,7 +346,8 @@ static void dw_edma_v0_write_ll_link(struct dw_edma_chunk *chunk,
 {
 	ptrdiff_t ofs = i * sizeof(struct dw_edma_v0_lli);
 
-	if (chunk->chan->dw->chip->flags & DW_EDMA_CHIP_LOCAL) {
+	if (chunk->chan->dw->chip->flags &
+	    (DW_EDMA_CHIP_LOCAL | DW_EDMA_CHIP_LL_MEM)) {
 		struct dw_edma_v0_llp *llp = chunk->ll_region.vaddr.mem + ofs;
 
 		llp->llp.reg = pointer;
@@ -407,10 +440,17 @@ static void dw_edma_v0_core_start(struct dw_edma_chunk *chunk, bool first)
 				break;
 			}
 		}
-		/* Interrupt unmask - done, abort */
+		/* Interrupt unmask - done, abort
+		 * Polled channels keep them masked, the status is still latched.
+		 */
 		tmp = GET_RW_32(dw, chan->dir, int_mask);
-		tmp &= ~FIELD_PREP(EDMA_V0_DONE_INT_MASK, BIT(chan->id));
-		tmp &= ~FIELD_PREP(EDMA_V0_ABORT_INT_MASK, BIT(chan->id));
+		if (chan->polled) {
+			tmp |= FIELD_PREP(EDMA_V0_DONE_INT_MASK, BIT(chan->id));
+			tmp |= FIELD_PREP(EDMA_V0_ABORT_INT_MASK, BIT(chan->id));
+		} else {
+			tmp &= ~FIELD_PREP(EDMA_V0_DONE_INT_MASK, BIT(chan->id));
+			tmp &= ~FIELD_PREP(EDMA_V0_ABORT_INT_MASK, BIT(chan->id));
+		}
 		SET_RW_32(dw, chan->dir, int_mask, tmp);
 		/* Linked list error */
 		tmp = GET_RW_32(dw, chan->dir, linked_list_err_en);
@@ -427,7 +467,8 @@ static void dw_edma_v0_core_start(struct dw_edma_chunk *chunk, bool first)
 			  upper_32_bits(chunk->ll_region.paddr));
 	}
 
-	if (!(chunk->chan->dw->chip->flags & DW_EDMA_CHIP_LOCAL))
+	if (!(chunk->chan->dw->chip->flags &
+	      (DW_EDMA_CHIP_LOCAL | DW_EDMA_CHIP_LL_MEM)))
 		/* Make sure Linked List has been written.
 		 * Linux memory barriers don't cater for what's required here.
 		 * What's required is what's here - a read of the linked
@@ -520,6 +561,7 @@ static const struct dw_edma_core_ops dw_edma_v0_core = {
 	.ch_count = dw_edma_v0_core_ch_count,
 	.ch_status = dw_edma_v0_core_ch_status,
 	.handle_int = dw_edma_v0_core_handle_int,
+	.ch_poll = dw_edma_v0_core_ch_poll,
 	.start = dw_edma_v0_core_start,
 	.ch_config = dw_edma_v0_core_ch_config,
 	.debugfs_on = dw_edma_v0_core_debugfs_on,
@@ -82,7 +82,7 @@ static enum dma_status dw_hdma_v0_core_ch_status(struct dw_edma_chan *chan)
 	u32 tmp;
 
 	tmp = FIELD_GET(HDMA_V0_CH_STATUS_MASK,
-			GET_CH_32(dw, chan->id, chan->dir, ch_stat));
+			GET_CH_32(dw, chan->dir, chan->id, ch_stat));
 
 	if (tmp == 1)
 		return DMA_IN_PROGRESS;
@@ -113,12 +113,37 @@ static u32 dw_hdma_v0_core_status_int(struct dw_edma_chan *chan)
 	return GET_CH_32(dw, chan->dir, chan->id, int_stat);
 }
 
+static bool dw_hdma_v0_core_ch_poll(struct dw_edma_chan *chan,
+				    dw_edma_handler_t done,
+				    dw_edma_handler_t abort)
+{
+	bool handled = false;
+	u32 val;
+
+	val = dw_hdma_v0_core_status_int(chan);
+	if (FIELD_GET(HDMA_V0_STOP_INT_MASK, val)) {
+		dw_hdma_v0_core_clear_done_int(chan);
+		done(chan);
+
+		handled = true;
+	}
+
+	if (FIELD_GET(HDMA_V0_ABORT_INT_MASK, val)) {
+		dw_hdma_v0_core_clear_abort_int(chan);
+		abort(chan);
+
+		handled = true;
+	}
+
+	return handled;
+}
+
 static irqreturn_t
 dw_hdma_v0_core_handle_int(struct dw_edma_irq *dw_irq, enum dw_edma_dir dir,
 			   dw_edma_handler_t done, dw_edma_handler_t abort)
 {
 	struct dw_edma *dw = dw_irq->dw;
-	unsigned long total, pos, val;
+	unsigned long total, pos;
 	irqreturn_t ret = IRQ_NONE;
 	struct dw_edma_chan *chan;
 	unsigned long off, mask;
@@ -136,20 +161,12 @@ dw_hdma_v0_core_handle_int(struct dw_edma_irq *dw_irq, enum dw_edma_dir dir,
 	for_each_set_bit(pos, &mask, total) {
 		chan = &dw->chan[pos + off];
 
-		val = dw_hdma_v0_core_status_int(chan);
-		if (FIELD_GET(HDMA_V0_STOP_INT_MASK, val)) {
-			dw_hdma_v0_core_clear_done_int(chan);
-			done(chan);
-
-			ret = IRQ_HANDLED;
-		}
-
-		if (FIELD_GET(HDMA_V0_ABORT_INT_MASK, val)) {
-			dw_hdma_v0_core_clear_abort_int(chan);
-			abort(chan);
+		/* Polled channels are handled by dw_hdma_v0_core_ch_poll() */
+		if (chan->polled)
+			continue;
 
+		if (dw_hdma_v0_core_ch_poll(chan, done, abort))
 			ret = IRQ_HANDLED;
-		}
 	}
 
 	return ret;
@@ -160,7 +177,8 @@ static void dw_hdma_v0_write_ll_data(struct dw_edma_chunk *chunk, int i,
 {
 	ptrdiff_t ofs = i * sizeof(struct dw_hdma_v0_lli);
 
-	if (chunk->chan->dw->chip->flags & DW_EDMA_CHIP_LOCAL) {
+	if (chunk->chan->dw->chip->flags &
+	    (DW_EDMA_CHIP_LOCAL | DW_EDMA_CHIP_LL_MEM)) {
 		struct dw_hdma_v0_lli *lli = chunk->ll_region.vaddr.mem + ofs;
 
 		lli->transfer_size = size;
@@ -185,7 +203,8 @@ static void dw_hdma_v0_write_ll_link(struct dw_edma_chunk *chunk,
 {
 	ptrdiff_t ofs = i * sizeof(struct dw_hdma_v0_lli);
 
-	if (chunk->chan->dw->chip->flags & DW_EDMA_CHIP_LOCAL) {
+	if (chunk->chan->dw->chip->flags &
+	    (DW_EDMA_CHIP_LOCAL | DW_EDMA_CHIP_LL_MEM)) {
 		struct dw_hdma_v0_llp *llp = chunk->ll_region.vaddr.mem + ofs;
 
 		llp->llp.reg = pointer;
@@ -242,12 +261,22 @@ static void dw_hdma_v0_core_start(struct dw_edma_chunk *chunk, bool first)
 	if (first) {
 		/* Enable engine */
 		SET_CH_32(dw, chan->dir, chan->id, ch_en, BIT(0));
-		/* Interrupt enable&unmask - done, abort */
+		/* Interrupt enable&unmask - done, abort
+		 * Polled channels only latch the status, no interrupt is sent.
+		 */
 		tmp = GET_CH_32(dw, chan->dir, chan->id, int_setup) |
-		      HDMA_V0_STOP_INT_MASK | HDMA_V0_ABORT_INT_MASK |
-		      HDMA_V0_LOCAL_STOP_INT_EN | HDMA_V0_LOCAL_ABORT_INT_EN;
-		if (!(dw->chip->flags & DW_EDMA_CHIP_LOCAL))
-			tmp |= HDMA_V0_REMOTE_STOP_INT_EN | HDMA_V0_REMOTE_ABORT_INT_EN;
+		      HDMA_V0_STOP_INT_MASK | HDMA_V0_ABORT_INT_MASK;
+		if (chan->polled) {
+			tmp &= ~(HDMA_V0_LOCAL_STOP_INT_EN |
+				 HDMA_V0_LOCAL_ABORT_INT_EN |
+				 HDMA_V0_REMOTE_STOP_INT_EN |
+				 HDMA_V0_REMOTE_ABORT_INT_EN);
+		} else {
+			tmp |= HDMA_V0_LOCAL_STOP_INT_EN | HDMA_V0_LOCAL_ABORT_INT_EN;
+			if (!(dw->chip->flags & DW_EDMA_CHIP_LOCAL))
+				tmp |= HDMA_V0_REMOTE_STOP_INT_EN |
+				       HDMA_V0_REMOTE_ABORT_INT_EN;
+		}
 		SET_CH_32(dw, chan->dir, chan->id, int_setup, tmp);
 		/* Channel control */
 		SET_CH_32(dw, chan->dir, chan->id, control1, HDMA_V0_LINKLIST_EN);
@@ -262,7 +291,8 @@ static void dw_hdma_v0_core_start(struct dw_edma_chunk *chunk, bool first)
 	SET_CH_32(dw, chan->dir, chan->id, cycle_sync,
 		  HDMA_V0_CONSUMER_CYCLE_STAT | HDMA_V0_CONSUMER_CYCLE_BIT);
 
-	if (!(chunk->chan->dw->chip->flags & DW_EDMA_CHIP_LOCAL))
+	if (!(chunk->chan->dw->chip->flags &
+	      (DW_EDMA_CHIP_LOCAL | DW_EDMA_CHIP_LL_MEM)))
 		/* Make sure Linked List has been written.
 		 * Linux memory barriers don't cater for what's required here.
 		 * What's required is what's here - a read of the linked
@@ -299,6 +329,7 @@ static const struct dw_edma_core_ops dw_hdma_v0_core = {
 	.ch_count = dw_hdma_v0_core_ch_count,
 	.ch_status = dw_hdma_v0_core_ch_status,
 	.handle_int = dw_hdma_v0_core_handle_int,
+	.ch_poll = dw_hdma_v0_core_ch_poll,
 	.start = dw_hdma_v0_core_start,
 	.ch_config = dw_hdma_v0_core_ch_config,
 	.debugfs_on = dw_hdma_v0_core_debugfs_on,
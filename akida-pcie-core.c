@@ -5,29 +5,110 @@
  *
  * Author: Herve Codina <herve.codina@bootlin.com>
  */
+#include <linux/blkdev.h>
+#include <linux/capability.h>
 #include <linux/delay.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-resv.h>
 #include <linux/dmaengine.h>
 #include <linux/dma/edma.h>
+#include <linux/hrtimer.h>
 #include <linux/idr.h>
+#include <linux/kref.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
 #include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/mmu_context.h>
 #include <linux/module.h>
+#include <linux/overflow.h>
 #include <linux/pci.h>
 #include <linux/pci-epf.h>
 #include <linux/pci_ids.h>
+#include <linux/rwsem.h>
+#include <linux/scatterlist.h>
+#include <linux/sched/mm.h>
+#include <linux/sched/signal.h>
+#include <linux/slab.h>
 #include <linux/uaccess.h>
+#include <linux/uio.h>
+#include <linux/vmalloc.h>
 #include <linux/version.h>
 #include <linux/wait.h>
+#include <linux/workqueue.h>
 
 #if LINUX_VERSION_CODE <= KERNEL_VERSION(5, 4, 0)
 #include <linux/pci-aspm.h>
 #endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+#include <linux/dma-map-ops.h>
+#else
+#include <linux/dma-noncoherent.h>
+#endif
 
 #include "dw-edma-core.h"
 #include "akida-edma.h"
+#include "akida-pcie.h"
 
 static DEFINE_IDA(akida_1000_devno);
 static DEFINE_IDA(akida_1500_devno);
 
+static bool zero_copy = true;
+module_param(zero_copy, bool, 0644);
+MODULE_PARM_DESC(zero_copy, "DMA directly from/to pinned user pages (default: true)");
+
+static unsigned int zero_copy_min = SZ_16K;
+module_param(zero_copy_min, uint, 0644);
+MODULE_PARM_DESC(zero_copy_min, "Minimum transfer size using zero-copy (default: 16384)");
+
+static unsigned int stripe_min = SZ_256K;
+module_param(stripe_min, uint, 0644);
+MODULE_PARM_DESC(stripe_min, "Minimum transfer size per DMA channel when striping a transfer over free channels, 0 to disable (default: 262144)");
+
+static int poll_delay = -1;
+module_param(poll_delay, int, 0644);
+MODULE_PARM_DESC(poll_delay, "Sleep before busy-polling the completion of a RWF_HIPRI transfer: -1 none, 0 adaptive (half the mean transfer time), >0 fixed in us (default: -1)");
+
+static unsigned int poll_max = SZ_256K;
+module_param(poll_max, uint, 0644);
+MODULE_PARM_DESC(poll_max, "Largest RWF_HIPRI transfer whose completion is busy-polled, larger ones waiting for the DMA interrupt (default: 262144)");
+
+static unsigned int qos_slice = SZ_1M;
+module_param(qos_slice, uint, 0644);
+MODULE_PARM_DESC(qos_slice, "Slice size of bulk class transfers, latency class transfers waiting for a channel being served between slices, 0 to disable (default: 1048576)");
+
+static unsigned int dma_chans = 2;
+module_param(dma_chans, uint, 0444);
+MODULE_PARM_DESC(dma_chans, "DMA channels per direction, up to 8, limited by the controller and the DMA RAM linked-list area (default: 2)");
+
+static int dma_ram_offset = -1;
+module_param(dma_ram_offset, int, 0444);
+MODULE_PARM_DESC(dma_ram_offset, "Offset in BAR4 of the DMA RAM area, -1 for the build configuration (default: -1)");
+
+static int dma_ram_ll_size = -1;
+module_param(dma_ram_ll_size, int, 0444);
+MODULE_PARM_DESC(dma_ram_ll_size, "DMA RAM linked-list size per channel, at least 48 bytes, -1 for the build configuration (default: -1)");
+
+static int dma_ram_dt_size = -1;
+module_param(dma_ram_dt_size, int, 0444);
+MODULE_PARM_DESC(dma_ram_dt_size, "DMA RAM data size per channel, -1 for the build configuration (default: -1)");
+
+static unsigned int dma_ram_wc_size;
+module_param(dma_ram_wc_size, uint, 0444);
+MODULE_PARM_DESC(dma_ram_wc_size, "DMA RAM size after the DMA controller area only mapped write-combining, by mmap() at AKIDA_MMAP_WC_OFFSET, with no programmed I/O, rounded up to pages, AKD1500 only (default: 0)");
+
+static unsigned int ll_host_size;
+module_param(ll_host_size, uint, 0444);
+MODULE_PARM_DESC(ll_host_size, "Linked-list size per DMA channel in host memory, AKD1500 only, 0 to keep the linked-lists in the DMA RAM (default: 0)");
+
+static unsigned int host_ddr_size = SZ_16M;
+module_param(host_ddr_size, uint, 0444);
+MODULE_PARM_DESC(host_ddr_size, "Host DDR area size, AKD1500 only, multiple of 1 MiB up to 64 MiB, allocated in up to 4 chunks (default: 16777216)");
+
+static bool host_ddr_cached;
+module_param(host_ddr_cached, bool, 0444);
+MODULE_PARM_DESC(host_ddr_cached, "Map the host DDR area cacheable, the CPU accesses being synchronized by AKIDA_IOCTL_HOST_DDR_SYNC, AKD1500 only (default: N)");
+
 /* The DMA RAM area contains eDMA linked-list (LL) and data (DT).
  * This area is used by the eDMA controler and is located inside the device.
  * This physical address is from the eDMA point of view
@@ -36,93 +117,307 @@ static DEFINE_IDA(akida_1500_devno);
 #define AKIDA_DMA_RAM_PHY_ADDR	0x20000000
 #define AKIDA_DMA_RAM_PHY_OFFSET       0x0
 
-/* Linked-list: 64 bytes per channel */
-#define AKIDA_DMA_RAM_PHY_TX0_LL_OFFSET    0x00 + AKIDA_DMA_RAM_PHY_OFFSET
-#define AKIDA_DMA_RAM_PHY_TX0_LL_SIZE      0x40
-#define AKIDA_DMA_RAM_PHY_TX1_LL_OFFSET    0x40 + AKIDA_DMA_RAM_PHY_OFFSET
-#define AKIDA_DMA_RAM_PHY_TX1_LL_SIZE      0x40
-#define AKIDA_DMA_RAM_PHY_RX0_LL_OFFSET    0x80 + AKIDA_DMA_RAM_PHY_OFFSET
-#define AKIDA_DMA_RAM_PHY_RX0_LL_SIZE      0x40
-#define AKIDA_DMA_RAM_PHY_RX1_LL_OFFSET    0xC0 + AKIDA_DMA_RAM_PHY_OFFSET
-#define AKIDA_DMA_RAM_PHY_RX1_LL_SIZE      0x40
+/* Linked-list: 256 bytes */
+#define AKIDA_DMA_RAM_PHY_LL_OFFSET    0x00 + AKIDA_DMA_RAM_PHY_OFFSET
+#define AKIDA_DMA_RAM_PHY_LL_SIZE      0x100
 
 /* Data: Empty */
-#define AKIDA_DMA_RAM_PHY_TX0_DT_OFFSET    0x0 + AKIDA_DMA_RAM_PHY_OFFSET
-#define AKIDA_DMA_RAM_PHY_TX0_DT_SIZE        0
-#define AKIDA_DMA_RAM_PHY_TX1_DT_OFFSET    0x0 + AKIDA_DMA_RAM_PHY_OFFSET
-#define AKIDA_DMA_RAM_PHY_TX1_DT_SIZE        0
-#define AKIDA_DMA_RAM_PHY_RX0_DT_OFFSET    0x0 + AKIDA_DMA_RAM_PHY_OFFSET
-#define AKIDA_DMA_RAM_PHY_RX0_DT_SIZE        0
-#define AKIDA_DMA_RAM_PHY_RX1_DT_OFFSET    0x0 + AKIDA_DMA_RAM_PHY_OFFSET
-#define AKIDA_DMA_RAM_PHY_RX1_DT_SIZE        0
+#define AKIDA_DMA_RAM_PHY_DT_OFFSET    0x0 + AKIDA_DMA_RAM_PHY_OFFSET
+#define AKIDA_DMA_RAM_PHY_DT_SIZE        0
 
 #define AKIDA_DMA_RAM_PHY_SIZE 0x00000100 /* 256B */
 #endif
 
-#define AKIDA_DMA_RAM_PHY_LL_OFFSET(t,i) AKIDA_DMA_RAM_PHY_##t##i##_LL_OFFSET
-#define AKIDA_DMA_RAM_PHY_LL_SIZE(t,i)   AKIDA_DMA_RAM_PHY_##t##i##_LL_SIZE
-#define AKIDA_DMA_RAM_PHY_DT_OFFSET(t,i) AKIDA_DMA_RAM_PHY_##t##i##_DT_OFFSET
-#define AKIDA_DMA_RAM_PHY_DT_SIZE(t,i)   AKIDA_DMA_RAM_PHY_##t##i##_DT_SIZE
+/* The linked-list and data areas are split evenly between the channels,
+ * write (tx) channels first, then read (rx) channels. A channel needs at
+ * least 2 linked-list elements: one data element and the link element.
+ */
+#define AKIDA_DMA_LL_CHAN_MIN  (2 * EDMA_LL_SZ)
+
+/* Bounce buffers: allocated and DMA mapped once per channel, as blocks of
+ * physically contiguous pages. A chunk is submitted as a single descriptor,
+ * one burst per block. The block size is halved down to a page when the
+ * allocation fails, the buffer being shorter if the blocks are not enough.
+ * Several buffers per channel let the copy from/to the user buffer of a
+ * chunk overlap with the DMA transfer of another one.
+ */
+#define AKIDA_DMA_BOUNCE_NR          2
+#define AKIDA_DMA_BOUNCE_SIZE        SZ_1M
+#define AKIDA_DMA_BOUNCE_BLOCKS_MAX  8
+
+/* Bounce transfers are split in at least AKIDA_DMA_BOUNCE_SPLIT chunks, no
+ * smaller than AKIDA_DMA_BOUNCE_SPLIT_MIN, in order to be pipelined.
+ */
+#define AKIDA_DMA_BOUNCE_SPLIT      4
+#define AKIDA_DMA_BOUNCE_SPLIT_MIN  SZ_16K
 
-/* Maximum DMA transfer chunk size */
-#define AKIDA_DMA_XFER_MAX_SIZE  1024
+/* Maximum DMA channels per direction */
+#define AKIDA_DMA_CHAN_MAX  EDMA_MAX_WR_CH
 
+/* Polled transfer times are averaged per power of 2 of the transfer size */
+#define AKIDA_DMA_POLL_BUCKETS  32
+
+#define AKIDA_1000_BAR0_OFFSET 0xFCC00000
 #define AKIDA_1500_BAR2_OFFSET 0xFCC00000
 #define AKIDA_1500_BAR4_OFFSET 0x20000000
 #define AKIDA_1500_HOST_DDR_BASE 0xC0000000
-#define AKIDA_1500_HOST_DDR_SIZE_MAX  SZ_16M
-#define AKIDA_1500_HOST_DDR_SIZE_MIN  SZ_1M
+/* The host DDR area is made of physically contiguous chunks, each one mapped
+ * by its own outbound region, contiguous from the device point of view.
+ */
+#define AKIDA_1500_HOST_DDR_CHUNK_MAX  SZ_16M
+#define AKIDA_1500_HOST_DDR_CHUNK_MIN  SZ_1M
+#define AKIDA_1500_HOST_DDR_CHUNKS_MAX 4
+#define AKIDA_1500_HOST_DDR_SIZE_MAX \
+	(AKIDA_1500_HOST_DDR_CHUNKS_MAX * AKIDA_1500_HOST_DDR_CHUNK_MAX)
 #define AKIDA_1500_HOST_DDR_DMA_ATTRS (DMA_ATTR_NO_KERNEL_MAPPING | DMA_ATTR_NO_WARN)
+/* Linked-lists in host memory, seen by the DMA controller at this address */
+#define AKIDA_1500_LL_HOST_BASE      0xE0000000
+#define AKIDA_1500_LL_HOST_SIZE_MAX  SZ_16M
+/* Outbound regions of the windows, after the host DDR and linked-lists ones */
+#define AKIDA_1500_WIN_REGION_FIRST  (AKIDA_1500_HOST_DDR_CHUNKS_MAX + 1)
+
+/* Completion of a submitted transfer, signaled by the DMA callback or, on
+ * polled channels, found by polling the cookie.
+ */
+struct akida_dma_done {
+	struct completion done;
+	dma_cookie_t cookie;
+	size_t len;
+	ktime_t start;
+	/* Error reported by the DMA callback */
+	int status;
+};
+
+/* Small transfers within a BAR mapped window are done by programmed I/O.
+ * The per device limit (pio_max in sysfs) is bounded by AKIDA_PIO_SIZE_MAX.
+ */
+#define AKIDA_PIO_WIN_NR        3
+#define AKIDA_PIO_SIZE_DEFAULT  64
+#define AKIDA_PIO_SIZE_MAX      256
+
+struct akida_pio_win {
+	phys_addr_t dev_addr;
+	void __iomem *base;
+	resource_size_t size;
+};
+
+#define AKIDA_QOS_NR  2
+
+/* DMA channels of a direction, see akida_acquire_chans().
+ * A channel is taken by setting its bit in used, with no lock. Transfers
+ * waiting for a channel sleep exclusively on the queue of their class, so
+ * that a release wakes a single waiter, a latency class one first.
+ */
+struct akida_chan_pool {
+	unsigned long used;
+	struct akida_dma_chan *chans;
+	unsigned int nr_chans;
+	wait_queue_head_t wq[AKIDA_QOS_NR];
+	atomic_t waiting[AKIDA_QOS_NR];
+	atomic_t active[AKIDA_QOS_NR];
+};
+
+struct akida_dma_block {
+	struct page *page;
+	dma_addr_t dma_addr;
+	size_t size;
+};
+
+struct akida_dma_buf {
+	struct akida_dma_block block[AKIDA_DMA_BOUNCE_BLOCKS_MAX];
+	unsigned int nr_blocks;
+	size_t size;
+	struct akida_dma_done done;
+};
 
 struct akida_dma_chan {
 	struct dma_chan *chan;
-	struct completion dma_complete;
+	struct akida_dma_done dma_complete;
 	enum dma_transfer_direction dma_xfer_dir;
 	enum dma_data_direction dma_data_dir;
-	dma_addr_t dma_buf;
-	size_t dma_len;
-	bool is_used;
+	struct akida_dma_buf bounce[AKIDA_DMA_BOUNCE_NR];
+	struct akida_chan_pool *pool;
+	unsigned int index;
+	unsigned int qos_class;
+	bool polled;
+};
+
+/* DMA RAM layout, offsets from AKIDA_DMA_RAM_PHY_ADDR. The linked-list and
+ * data sizes are per channel.
+ */
+struct akida_dma_ram {
+	phys_addr_t offset;
+	size_t size;
+	phys_addr_t ll_offset;
+	size_t ll_size;
+	phys_addr_t dt_offset;
+	size_t dt_size;
+};
+
+/* Physically contiguous part of the host DDR area, at offset in the area */
+struct akida_host_ddr_chunk {
+	void *cpu_addr;
+	dma_addr_t dma_addr;
+	size_t offset;
+	size_t size;
+	/* Cacheable pages instead of a coherent allocation */
+	struct page *page;
+};
+
+/* Host DDR area of the AKD1500. It is refcounted as exported dma-bufs and
+ * user mappings may outlive the device.
+ */
+struct akida_host_ddr {
+	struct kref ref;
+	struct pci_dev *pdev;
+	struct akida_host_ddr_chunk chunk[AKIDA_1500_HOST_DDR_CHUNKS_MAX];
+	unsigned int nr_chunks;
+	size_t size;
+	bool cached;
 };
 
+/* Akida device. It is refcounted as the open files may outlive it: what they
+ * hold of the device is released on removal, see akida_file_detach().
+ */
 struct akida_dev {
+	struct kref ref;
 	struct pci_dev *pdev;
 	struct ida *ida;
 	int devno;
 	struct miscdevice miscdev;
 	struct dw_edma_chip edma_chip;
-	struct akida_dma_chan rxchan[2];
-	struct akida_dma_chan txchan[2];
-	wait_queue_head_t wq_rxchan;
-	wait_queue_head_t wq_txchan;
+	struct akida_dma_ram dma_ram;
+	struct akida_dma_chan *rxchan;
+	struct akida_dma_chan *txchan;
+	/* DMA channels per direction */
+	unsigned int nr_chans;
+	/* Channels per direction (0 rx, 1 tx) */
+	struct akida_chan_pool chan_pool[2];
+	/* Channels bound to a file, per direction */
+	atomic_t nr_bound[2];
+	/* Mean polled transfer time in ns, per direction and size */
+	u64 poll_mean_ns[2][AKIDA_DMA_POLL_BUCKETS];
+	/* Asynchronous transfers in flight, drained on removal */
+	spinlock_t aio_lock;
+	struct list_head aio_list;
+	wait_queue_head_t aio_wq;
+	/* Held for reading by the file operations using the device, for
+	 * writing to mark it removed, see akida_op_begin().
+	 */
+	struct rw_semaphore remove_lock;
+	bool removed;
+	/* Open files */
+	struct mutex files_lock;
+	struct list_head files;
+	struct akida_pio_win pio_win[AKIDA_PIO_WIN_NR];
+	unsigned int nr_pio_win;
+	/* BAR4 size after the DMA RAM area pages only mapped write-combining */
+	resource_size_t bar4_wc_size;
+	unsigned int pio_max;
 	void __iomem *mmio_bar0;
+	/* NULL if disabled */
+	struct akida_host_ddr *host_ddr;
+	/* DMA linked-lists of all the channels, in host memory */
 	struct {
 		void *cpu_addr;
 		dma_addr_t dma_addr;
 		size_t size;
-	} host_ddr;
+	} ll_host;
+	/* Outbound windows, per region, see AKIDA_IOCTL_WIN_MAP */
+	struct mutex win_lock;
+	struct akida_outwin *win[AKIDA_WIN_REGIONS_MAX];
+};
+
+/* Per open file state */
+struct akida_file {
+	struct akida_dev *akida;
+	/* In akida->files */
+	struct list_head node;
+	struct mutex lock;
+	struct akida_ring *ring;
+	/* Registered buffers, see AKIDA_IOCTL_BUF_REGISTER */
+	spinlock_t bufs_lock;
+	struct akida_regbuf *bufs[AKIDA_BUF_MAX];
+	/* Channels bound to the file, per direction (0 rx, 1 tx), see
+	 * AKIDA_IOCTL_CHAN_BIND. The mutex is held while a channel is used.
+	 */
+	struct mutex bind_lock[2];
+	struct akida_dma_chan *bound[2];
+	/* Default transfer class, see AKIDA_IOCTL_SET_QOS */
+	unsigned int qos_class;
 };
 
+static inline struct akida_dev *akida_file_dev(struct file *file)
+{
+	struct akida_file *af = file->private_data;
+
+	return af->akida;
+}
+
+static void akida_dev_release(struct kref *ref)
+{
+	struct akida_dev *akida = container_of(ref, struct akida_dev, ref);
+
+	pci_dev_put(akida->pdev);
+	kfree(akida);
+}
+
+static void akida_dev_put(struct akida_dev *akida)
+{
+	kref_put(&akida->ref, akida_dev_release);
+}
+
+/* Start a file operation using the device, -ENODEV once it is removed. The
+ * removal waits for the operations in progress.
+ */
+static int akida_op_begin(struct akida_dev *akida)
+{
+	down_read(&akida->remove_lock);
+	if (akida->removed) {
+		up_read(&akida->remove_lock);
+		return -ENODEV;
+	}
+
+	return 0;
+}
+
+static void akida_op_end(struct akida_dev *akida)
+{
+	up_read(&akida->remove_lock);
+}
+
 enum {
 	AKIDA_1000 = 0,
 	AKIDA_1500 = 1,
 };
 
-static void akida_dma_callback(void *arg)
+/* Error code of a completed descriptor */
+static int akida_dma_result(const struct dmaengine_result *result)
+{
+	if (!result || result->result == DMA_TRANS_NOERROR)
+		return 0;
+
+	return -EIO;
+}
+
+static void akida_dma_callback(void *arg,
+			       const struct dmaengine_result *result)
 {
-	struct akida_dma_chan *dma_chan = arg;
+	struct akida_dma_done *done = arg;
 
-	dma_unmap_single(dma_chan->chan->device->dev,
-		dma_chan->dma_buf, dma_chan->dma_len, dma_chan->dma_data_dir);
-	complete(&dma_chan->dma_complete);
+	done->status = akida_dma_result(result);
+	complete(&done->done);
 }
 
-static int akida_dma_transfer(struct akida_dev *akida,
+/* Return the cookie of the submitted transfer or a negative error code */
+static int akida_dma_submit_sg_cb(struct akida_dev *akida,
 	struct akida_dma_chan *dma_chan, phys_addr_t dev_addr,
-	size_t len, void *buf)
+	struct scatterlist *sgl, unsigned int nents,
+	dma_async_tx_callback_result callback, void *callback_param)
 {
 	struct dma_slave_config dma_sconfig = {0};
 	struct dma_async_tx_descriptor *txdesc;
-	struct device *chan_dev;
+	dma_cookie_t cookie;
 	int ret;
 
 	/* Set parameters
@@ -145,16 +440,6 @@ static int akida_dma_transfer(struct akida_dev *akida,
 		return -EINVAL;
 	}
 
-	/* Map buffer */
-	dma_chan->dma_len = len;
-	chan_dev = dma_chan->chan->device->dev;
-	dma_chan->dma_buf = dma_map_single(chan_dev, buf, dma_chan->dma_len,
-					   dma_chan->dma_data_dir);
-	if (dma_mapping_error(chan_dev, dma_chan->dma_buf)) {
-		pci_err(akida->pdev, "DMA mapping failed\n");
-		return -EINVAL;
-	}
-
 	/* Update dma_sconfig
 	 * Upstream commit 05655541c950 - dmaengine: dw-edma: Fix scatter-gather address calculation
 	 * This commit was backported to 5.4.x
@@ -165,298 +450,3577 @@ static int akida_dma_transfer(struct akida_dev *akida,
 	 * kernels with or without the modification.
 	 */
 	if (dma_chan->dma_xfer_dir == DMA_MEM_TO_DEV)
-		dma_sconfig.src_addr = dma_chan->dma_buf;
+		dma_sconfig.src_addr = sg_dma_address(sgl);
 	else
-		dma_sconfig.dst_addr = dma_chan->dma_buf;
+		dma_sconfig.dst_addr = sg_dma_address(sgl);
 
 	ret = dmaengine_slave_config(dma_chan->chan, &dma_sconfig);
 	if (ret < 0) {
 		pci_err(akida->pdev, "DMA slave config failed (%d)\n", ret);
-		goto err;
+		return ret;
 	}
 
 	/* Prepare transaction */
-	txdesc = dmaengine_prep_slave_single(dma_chan->chan,
-					     dma_chan->dma_buf, dma_chan->dma_len,
-					     dma_chan->dma_xfer_dir,
-					     DMA_PREP_INTERRUPT);
+	txdesc = dmaengine_prep_slave_sg(dma_chan->chan, sgl, nents,
+					 dma_chan->dma_xfer_dir,
+					 DMA_PREP_INTERRUPT);
 	if (!txdesc) {
 		pci_err(akida->pdev, "Not able to get desc for DMA xfer\n");
-		ret = -EINVAL;
-		goto err;
+		return -EINVAL;
 	}
 
-	/* Clear completion */
-	reinit_completion(&dma_chan->dma_complete);
-
 	/* Submit transaction */
-	txdesc->callback = akida_dma_callback;
-	txdesc->callback_param = dma_chan;
-	ret = dma_submit_error(dmaengine_submit(txdesc));
+	txdesc->callback_result = callback;
+	txdesc->callback_param = callback_param;
+	cookie = dmaengine_submit(txdesc);
+	ret = dma_submit_error(cookie);
 	if (ret < 0) {
 		pci_err(akida->pdev, "DMA submit failed\n");
-		goto err;
+		return ret;
 	}
 
-	/* Start transactions */
+	/* Start transactions
+	 * If a transaction is already running on the channel, this one is
+	 * started by the engine as soon as the previous one is done.
+	 */
 	dma_async_issue_pending(dma_chan->chan);
 
-	/* Wait for completion */
-	ret = wait_for_completion_timeout(&dma_chan->dma_complete,
-					  msecs_to_jiffies(2000));
-	if (!ret) {
-		pci_err(akida->pdev, "DMA wait completion timed out\n");
-		dmaengine_terminate_all(dma_chan->chan);
-		ret = -ETIMEDOUT;
-		goto err;
+	return cookie;
+}
+
+static int akida_dma_submit_sg(struct akida_dev *akida,
+	struct akida_dma_chan *dma_chan, phys_addr_t dev_addr,
+	struct scatterlist *sgl, unsigned int nents,
+	struct akida_dma_done *done)
+{
+	struct scatterlist *sg;
+	unsigned int i;
+	int ret;
+
+	/* Transfers on polled channels are completed by akida_dma_poll(), a
+	 * callback would race with the reuse of the completion.
+	 */
+	if (dma_chan->polled) {
+		done->len = 0;
+		for_each_sg(sgl, sg, nents, i)
+			done->len += sg_dma_len(sg);
+		done->start = ktime_get();
+
+		ret = akida_dma_submit_sg_cb(akida, dma_chan, dev_addr, sgl,
+					     nents, NULL, NULL);
+		if (ret < 0)
+			return ret;
+
+		done->cookie = ret;
+		return 0;
 	}
 
-	/* Ok, everything is done (unmap done in dma transaction callback) */
-	return 0;
+	/* Clear completion */
+	reinit_completion(&done->done);
 
-err:
-	dma_unmap_single(chan_dev, dma_chan->dma_buf, dma_chan->dma_len,
-			 dma_chan->dma_data_dir);
-	return ret;
+	ret = akida_dma_submit_sg_cb(akida, dma_chan, dev_addr, sgl, nents,
+				     akida_dma_callback, done);
+	return ret < 0 ? ret : 0;
+}
+
+/* Stop the transfers of a channel and wait for the engine to stop, before
+ * their buffers are released. dmaengine_terminate_sync() would skip the wait
+ * when the channel is already stopping.
+ */
+static void akida_dma_terminate(struct akida_dma_chan *dma_chan)
+{
+	dmaengine_terminate_async(dma_chan->chan);
+	dmaengine_synchronize(dma_chan->chan);
 }
 
-static bool akida_is_allowed(phys_addr_t addr, size_t size)
+static int akida_dma_wait(struct akida_dev *akida,
+	struct akida_dma_chan *dma_chan, struct completion *done)
 {
-	/* Overlap with DMA RAM reserved area is not allowed */
-	return (addr+size) < (AKIDA_DMA_RAM_PHY_ADDR + AKIDA_DMA_RAM_PHY_OFFSET)  ||
-		(AKIDA_DMA_RAM_PHY_ADDR + AKIDA_DMA_RAM_PHY_OFFSET + AKIDA_DMA_RAM_PHY_SIZE) <= addr;
+	int ret;
+
+	ret = wait_for_completion_timeout(done, msecs_to_jiffies(2000));
+	if (!ret) {
+		pci_err(akida->pdev, "DMA wait completion timed out\n");
+		akida_dma_terminate(dma_chan);
+		return -ETIMEDOUT;
+	}
+
+	return 0;
 }
 
-static struct akida_dma_chan *akida_get_unsused_chan(
-					struct akida_dma_chan *tab_chan,
-					unsigned int nb_chan)
+/* Polled channels: interrupts of the channels are masked and the completion of
+ * their transfers is busy-polled. A channel must be idle to change its mode.
+ */
+static void akida_dma_set_polled(struct akida_dma_chan **chans,
+				 unsigned int nr_chans, bool polled)
 {
 	unsigned int i;
 
-	for (i = 0; i < nb_chan; i++) {
-		if (!(tab_chan+i)->is_used)
-			return tab_chan+i;
+	for (i = 0; i < nr_chans; i++) {
+		chans[i]->polled = polled;
+		akida_dw_edma_set_polled(chans[i]->chan, polled);
 	}
-	return NULL;
 }
 
-static struct akida_dma_chan *akida_acquire_chan(wait_queue_head_t *wq,
-					struct akida_dma_chan *tab_chan,
-					unsigned int nb_chan)
+static u64 *akida_dma_poll_mean(struct akida_dev *akida,
+	struct akida_dma_chan *dma_chan, size_t len)
 {
-	struct akida_dma_chan *chan;
-	int ret;
+	unsigned int bucket = len ? min_t(unsigned int, ilog2(len),
+					  AKIDA_DMA_POLL_BUCKETS - 1) : 0;
+
+	return &akida->poll_mean_ns[dma_chan->dma_data_dir == DMA_TO_DEVICE][bucket];
+}
 
-	spin_lock(&wq->lock);
+/* Time to sleep before polling, from the submission of the transfer */
+static u64 akida_dma_poll_delay(struct akida_dev *akida,
+	struct akida_dma_chan *dma_chan, size_t len)
+{
+	if (poll_delay < 0)
+		return 0;
+	if (poll_delay > 0)
+		return (u64)poll_delay * NSEC_PER_USEC;
 
-	ret = wait_event_interruptible_locked(*wq,
-		(chan = akida_get_unsused_chan(tab_chan, nb_chan)));
-	if (ret) {
-		spin_unlock(&wq->lock);
-		return ERR_PTR(ret);
+	/* Adaptive: sleep for half the mean time of similar transfers */
+	return READ_ONCE(*akida_dma_poll_mean(akida, dma_chan, len)) / 2;
+}
+
+/* Poll the completion of a transfer submitted on a polled channel, after
+ * sleeping for part of the expected transfer time if poll_delay is set.
+ */
+static int akida_dma_poll(struct akida_dev *akida,
+	struct akida_dma_chan *dma_chan, struct akida_dma_done *done)
+{
+	ktime_t timeout = ktime_add_ms(done->start, 2000);
+	u64 *mean;
+	ktime_t kt;
+	u64 delay;
+	s64 ns;
+
+	delay = akida_dma_poll_delay(akida, dma_chan, done->len);
+	ns = (s64)delay - ktime_to_ns(ktime_sub(ktime_get(), done->start));
+	if (ns > 0) {
+		kt = ns_to_ktime(ns);
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		schedule_hrtimeout(&kt, HRTIMER_MODE_REL);
 	}
 
-	chan->is_used = true;
+	while (dma_async_is_tx_complete(dma_chan->chan, done->cookie,
+					NULL, NULL) != DMA_COMPLETE) {
+		if (akida_dw_edma_poll(dma_chan->chan))
+			continue;
+
+		if (ktime_after(ktime_get(), timeout)) {
+			pci_err(akida->pdev, "DMA poll completion timed out\n");
+			akida_dma_terminate(dma_chan);
+			return -ETIMEDOUT;
+		}
 
-	spin_unlock(&wq->lock);
+		/* The interrupts of the channel are masked, there is no
+		 * completion to sleep on: give the CPU up when needed, the
+		 * transfer running meanwhile.
+		 */
+		if (need_resched())
+			schedule();
+		else
+			cpu_relax();
+	}
 
-	return chan;
+	/* Moving average with a 1/8 weight for the new sample */
+	mean = akida_dma_poll_mean(akida, dma_chan, done->len);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), done->start));
+	WRITE_ONCE(*mean, *mean ? *mean - *mean / 8 + ns / 8 : ns);
+
+	return 0;
 }
 
-static void akida_release_chan(wait_queue_head_t *wq, struct akida_dma_chan *chan)
+static int akida_dma_wait_done(struct akida_dev *akida,
+	struct akida_dma_chan *dma_chan, struct akida_dma_done *done)
 {
-	spin_lock(&wq->lock);
-	chan->is_used = false;
-	wake_up_locked(wq);
-	spin_unlock(&wq->lock);
+	int ret;
+
+	if (dma_chan->polled)
+		return akida_dma_poll(akida, dma_chan, done);
+
+	ret = akida_dma_wait(akida, dma_chan, &done->done);
+	return ret ? ret : done->status;
 }
 
-static inline struct akida_dma_chan *akida_acquire_rxchan(struct akida_dev *akida)
+/* Give [off, off + len) of a bounce buffer to the device or back to the CPU */
+static void akida_bounce_sync(struct akida_dma_chan *dma_chan,
+	struct akida_dma_buf *bounce, size_t off, size_t len, bool for_device)
 {
-	return akida_acquire_chan(&akida->wq_rxchan, akida->rxchan,
-				  ARRAY_SIZE(akida->rxchan));
+	struct device *dev = dma_chan->chan->device->dev;
+	struct akida_dma_block *b;
+	size_t part;
+
+	for (b = bounce->block; len; b++) {
+		if (off >= b->size) {
+			off -= b->size;
+			continue;
+		}
+		part = min(len, b->size - off);
+		if (for_device)
+			dma_sync_single_range_for_device(dev, b->dma_addr, off,
+							 part,
+							 dma_chan->dma_data_dir);
+		else
+			dma_sync_single_range_for_cpu(dev, b->dma_addr, off,
+						      part,
+						      dma_chan->dma_data_dir);
+		off = 0;
+		len -= part;
+	}
 }
 
-static inline void akida_release_rxchan(struct akida_dev *akida, struct akida_dma_chan *rxchan)
+/* Copy [off, off + len) of a bounce buffer from or to a user buffer */
+static int akida_bounce_copy(struct akida_dma_buf *bounce, size_t off,
+			     size_t len, struct iov_iter *iter, bool to_user)
 {
-	akida_release_chan(&akida->wq_rxchan, rxchan);
+	struct akida_dma_block *b;
+	size_t part, n;
+	void *p;
+
+	for (b = bounce->block; len; b++) {
+		if (off >= b->size) {
+			off -= b->size;
+			continue;
+		}
+		part = min(len, b->size - off);
+		p = page_address(b->page) + off;
+		n = to_user ? copy_to_iter(p, part, iter) :
+			      copy_from_iter(p, part, iter);
+		if (n != part)
+			return -EFAULT;
+		off = 0;
+		len -= part;
+	}
+
+	return 0;
 }
 
-static inline struct akida_dma_chan *akida_acquire_txchan(struct akida_dev *akida)
+/* Scatter-gather list of [off, off + len) of a bounce buffer, one entry per
+ * block. The list is only read when the descriptor is prepared.
+ */
+static unsigned int akida_bounce_sg(struct akida_dma_buf *bounce, size_t off,
+				    size_t len, struct scatterlist *sgl)
 {
-	return akida_acquire_chan(&akida->wq_txchan, akida->txchan,
-				  ARRAY_SIZE(akida->txchan));
+	struct akida_dma_block *b;
+	unsigned int nents = 0;
+	size_t part;
+
+	sg_init_table(sgl, AKIDA_DMA_BOUNCE_BLOCKS_MAX);
+	for (b = bounce->block; len; b++) {
+		if (off >= b->size) {
+			off -= b->size;
+			continue;
+		}
+		part = min(len, b->size - off);
+		sg_dma_address(&sgl[nents]) = b->dma_addr + off;
+		sg_dma_len(&sgl[nents]) = part;
+		nents++;
+		off = 0;
+		len -= part;
+	}
+	sg_mark_end(&sgl[nents - 1]);
+
+	return nents;
 }
 
-static inline void akida_release_txchan(struct akida_dev *akida, struct akida_dma_chan *txchan)
+static int akida_dma_submit_bounce(struct akida_dev *akida,
+	struct akida_dma_chan *dma_chan, phys_addr_t dev_addr,
+	struct akida_dma_buf *bounce, size_t size)
 {
-	akida_release_chan(&akida->wq_txchan, txchan);
+	struct scatterlist sgl[AKIDA_DMA_BOUNCE_BLOCKS_MAX];
+	unsigned int nents;
+
+	akida_bounce_sync(dma_chan, bounce, 0, size, true);
+	nents = akida_bounce_sg(bounce, 0, size, sgl);
+
+	return akida_dma_submit_sg(akida, dma_chan, dev_addr, sgl, nents,
+				   &bounce->done);
 }
 
-static ssize_t akida_read(struct file *file, char __user *buf,
-			  size_t sz, loff_t *ppos)
+static int akida_dma_wait_bounce(struct akida_dev *akida,
+	struct akida_dma_chan *dma_chan, struct akida_dma_buf *bounce,
+	size_t size)
 {
-	struct akida_dev *akida =
-		container_of(file->private_data, struct akida_dev, miscdev);
-	void *tmp;
-	ssize_t ret;
-	size_t left;
-	size_t size;
-	char __user *usr_buf;
-	struct akida_dma_chan *rxchan;
+	int ret;
 
-	if (!akida_is_allowed(*ppos, sz)) {
-		pci_err(akida->pdev, "dma transfer @0x%llx, %zu bytes not allowed\n",
-			*ppos, sz);
-		return -EINVAL;
-	}
+	ret = akida_dma_wait_done(akida, dma_chan, &bounce->done);
 
-	tmp = kmalloc(AKIDA_DMA_XFER_MAX_SIZE, GFP_KERNEL);
-	if (tmp == NULL)
-		return -ENOMEM;
+	akida_bounce_sync(dma_chan, bounce, 0, size, false);
+	return ret;
+}
 
-	rxchan = akida_acquire_rxchan(akida);
-	if (IS_ERR(rxchan)) {
-		kfree(tmp);
-		return PTR_ERR(rxchan);
-	}
+/* Bounce buffer slot i of a transfer striped over nr_chans channels */
+static struct akida_dma_buf *akida_dma_bounce_slot(
+	struct akida_dma_chan **chans, unsigned int nr_chans, unsigned int i,
+	struct akida_dma_chan **dma_chan)
+{
+	*dma_chan = chans[i % nr_chans];
+	return &(*dma_chan)->bounce[i / nr_chans];
+}
 
-	left = sz;
-	usr_buf = buf;
-	while (left) {
-		/* Limit transfer chunk ... */
-		size = left > AKIDA_DMA_XFER_MAX_SIZE ?
-			AKIDA_DMA_XFER_MAX_SIZE : left;
+static int akida_dma_transfer_bounce(struct akida_dev *akida,
+	struct akida_dma_chan **chans, unsigned int nr_chans,
+	phys_addr_t dev_addr, struct iov_iter *iter, size_t len)
+{
+	bool to_user = chans[0]->dma_data_dir == DMA_FROM_DEVICE;
+	size_t size[AKIDA_DMA_CHAN_MAX * AKIDA_DMA_BOUNCE_NR];
+	unsigned int nr_slots = nr_chans * AKIDA_DMA_BOUNCE_NR;
+	struct akida_dma_chan *dma_chan;
+	struct akida_dma_buf *bounce;
+	unsigned int submitted = 0;
+	unsigned int completed = 0;
+	unsigned int i;
+	size_t split;
+	int ret = 0;
+	int err;
+
+	/* The transfer is split in chunks going round-robin through the
+	 * channels and their bounce buffers.
+	 *  - Writes: the copy from the user buffer of a chunk is done while
+	 *    the previous chunks are transferred.
+	 *  - Reads: the copy to the user buffer of a chunk is done while
+	 *    the next chunks are transferred.
+	 */
+	split = max_t(size_t, DIV_ROUND_UP(len, AKIDA_DMA_BOUNCE_SPLIT * nr_chans),
+		      AKIDA_DMA_BOUNCE_SPLIT_MIN);
+
+	while (len || completed != submitted) {
+		/* Submit a new chunk if a bounce buffer is available ... */
+		if (len && submitted - completed < nr_slots) {
+			i = submitted % nr_slots;
+			bounce = akida_dma_bounce_slot(chans, nr_chans, i,
+						       &dma_chan);
+			size[i] = min3(len, bounce->size, split);
+
+			if (!to_user) {
+				ret = akida_bounce_copy(bounce, 0, size[i],
+							iter, false);
+				if (ret)
+					break;
+			}
+
+			ret = akida_dma_submit_bounce(akida, dma_chan, dev_addr,
+						      bounce, size[i]);
+			if (ret < 0)
+				break;
+
+			dev_addr += size[i];
+			len -= size[i];
+			submitted++;
+			continue;
+		}
 
-		/* ... do transfer ... */
-		ret = akida_dma_transfer(akida, rxchan, *ppos, size, tmp);
+		/* ... else wait for the oldest one to be done */
+		i = completed % nr_slots;
+		bounce = akida_dma_bounce_slot(chans, nr_chans, i, &dma_chan);
+		ret = akida_dma_wait_bounce(akida, dma_chan, bounce, size[i]);
 		if (ret < 0)
-			goto end;
+			goto terminate;
+		completed++;
 
-		/* ... copy transfered chunk to the user buffer */
-		if (copy_to_user(usr_buf, tmp, size)) {
-			ret = -EFAULT;
-			goto end;
+		if (to_user) {
+			ret = akida_bounce_copy(bounce, 0, size[i], iter, true);
+			if (ret)
+				break;
 		}
+	}
 
-		*ppos += size;
-		usr_buf += size;
-		left -= size;
+	/* On error, let the chunks already submitted complete before
+	 * releasing the bounce buffers.
+	 */
+	while (completed != submitted) {
+		i = completed % nr_slots;
+		bounce = akida_dma_bounce_slot(chans, nr_chans, i, &dma_chan);
+		err = akida_dma_wait_bounce(akida, dma_chan, bounce, size[i]);
+		if (err < 0) {
+			ret = ret < 0 ? ret : err;
+			goto terminate;
+		}
+		completed++;
 	}
 
-	ret = sz;
-end:
-	akida_release_rxchan(akida, rxchan);
-	kfree(tmp);
+	return ret;
+
+terminate:
+	/* A chunk timed out, stop the chunks in flight on the other channels
+	 * before the bounce buffers are reused.
+	 */
+	for (i = 0; i < nr_chans; i++)
+		akida_dma_terminate(chans[i]);
 	return ret;
 }
 
-static ssize_t akida_write(struct file *file, const char __user *buf,
-			   size_t sz, loff_t *ppos)
+static int akida_pin_user_pages(unsigned long uaddr, unsigned int nr_pages,
+				unsigned int gup_flags, struct page **pages)
 {
-	struct akida_dev *akida =
-		container_of(file->private_data, struct akida_dev, miscdev);
-	void *tmp;
-	ssize_t ret;
-	size_t left;
-	size_t size;
-	const char __user *usr_buf;
-	struct akida_dma_chan *txchan;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 6, 0)
+	return get_user_pages_fast(uaddr, nr_pages, gup_flags, pages);
+#else
+	return pin_user_pages_fast(uaddr, nr_pages, gup_flags, pages);
+#endif
+}
 
-	if (!akida_is_allowed(*ppos, sz)) {
-		pci_err(akida->pdev, "dma transfer @0x%llx, %zu bytes not allowed\n",
-			*ppos, sz);
-		return -EINVAL;
+static void akida_unpin_user_pages(struct page **pages, unsigned int nr_pages,
+				   bool dirty)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 6, 0)
+	unsigned int i;
+
+	for (i = 0; i < nr_pages; i++) {
+		if (dirty)
+			set_page_dirty_lock(pages[i]);
+		put_page(pages[i]);
 	}
+#else
+	unpin_user_pages_dirty_lock(pages, nr_pages, dirty);
+#endif
+}
 
-	tmp = kmalloc(AKIDA_DMA_XFER_MAX_SIZE, GFP_KERNEL);
-	if (tmp == NULL)
-		return -ENOMEM;
+static bool akida_iter_is_user(const struct iov_iter *iter)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 0, 0)
+	return iter_is_iovec(iter);
+#else
+	return user_backed_iter(iter);
+#endif
+}
 
-	txchan = akida_acquire_txchan(akida);
-	if (IS_ERR(txchan)) {
-		kfree(tmp);
-		return PTR_ERR(txchan);
+/* Current segment of a user backed iov_iter */
+static struct iovec akida_iter_iovec(const struct iov_iter *iter)
+{
+	struct iovec iov;
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6, 0, 0)
+	iov = iov_iter_iovec(iter);
+#elif LINUX_VERSION_CODE < KERNEL_VERSION(6, 4, 0)
+	if (iter_is_ubuf(iter)) {
+		iov.iov_base = iter->ubuf + iter->iov_offset;
+		iov.iov_len = iov_iter_count(iter);
+	} else {
+		iov = iov_iter_iovec(iter);
 	}
+#else
+	iov.iov_base = iter_iov_addr(iter);
+	iov.iov_len = min(iter_iov_len(iter), iov_iter_count(iter));
+#endif
+	return iov;
+}
 
-	left = sz;
-	usr_buf = buf;
-	while (left) {
-		/* Limit transfer chunk ... */
-		size = left > AKIDA_DMA_XFER_MAX_SIZE ?
-			AKIDA_DMA_XFER_MAX_SIZE : left;
+/* User buffer of an iov_iter made of a single user segment, NULL otherwise */
+static void __user *akida_iter_user_buf(const struct iov_iter *iter)
+{
+	struct iovec iov;
 
-		/* ... copy chunk from the user buffer ... */
-		if (copy_from_user(tmp, usr_buf, size)) {
-			ret = -EFAULT;
-			goto end;
-		}
+	if (!akida_iter_is_user(iter))
+		return NULL;
 
-		/* ... do transfer */
-		ret = akida_dma_transfer(akida, txchan, *ppos, size, tmp);
-		if (ret < 0)
-			goto end;
+	iov = akida_iter_iovec(iter);
+	if (iov.iov_len != iov_iter_count(iter))
+		return NULL;
 
-		*ppos += size;
-		usr_buf += size;
-		left -= size;
-	}
+	return iov.iov_base;
+}
 
-	ret = sz;
+/* Alignment of user buffers accessed by the device.
+ * The device must not share a cache line with unrelated user data: on non
+ * cache-coherent platforms, the cache maintenance done on the partial lines
+ * would corrupt it.
+ */
+static unsigned long akida_dma_user_align(void)
+{
+	return max_t(unsigned long, dma_get_cache_alignment(), sizeof(u32));
+}
 
-end:
-	akida_release_txchan(akida, txchan);
-	kfree(tmp);
-	return ret;
+/* Whether all the segments of an iov_iter are user buffers aligned for
+ * zero-copy.
+ */
+static bool akida_iter_is_aligned(const struct iov_iter *iter)
+{
+	unsigned long align = akida_dma_user_align();
+	struct iov_iter it = *iter;
+	struct iovec iov;
+
+	if (!akida_iter_is_user(iter))
+		return false;
+
+	while (iov_iter_count(&it)) {
+		iov = akida_iter_iovec(&it);
+		if (!iov.iov_len ||
+		    !IS_ALIGNED((unsigned long)iov.iov_base | iov.iov_len, align))
+			return false;
+		iov_iter_advance(&it, iov.iov_len);
+	}
+
+	return true;
 }
 
-static const struct vm_operations_struct akida_vm_ops = {
-#ifdef CONFIG_HAVE_IOREMAP_PROT
-	.access = generic_access_phys,
-#endif
+/* Pinned and DMA mapped user buffer */
+struct akida_user_sg {
+	struct page **pages;
+	unsigned int nr_pages;
+	struct sg_table sgt;
+	unsigned int nr_sg;
+	int nents;
+	/* Set if the pages belong to a registered buffer */
+	struct akida_regbuf *reg;
 };
 
-static int akida_mmap(struct akida_dev *akida, unsigned int bar, struct vm_area_struct *vma)
+/* Pin and map the len next bytes of a user backed iov_iter, possibly spread
+ * over several segments, in a single scatter-gather list.
+ * The iov_iter is advanced by len.
+ */
+static int akida_user_sg_map(struct akida_dev *akida,
+	struct akida_dma_chan *dma_chan, struct akida_user_sg *usg,
+	struct iov_iter *iter, size_t len)
 {
-	vma->vm_pgoff += (pci_resource_start(akida->pdev, bar) >> PAGE_SHIFT);
-	vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
-	vma->vm_ops = &akida_vm_ops;
+	bool to_user = dma_chan->dma_data_dir == DMA_FROM_DEVICE;
+	struct scatterlist *sg = NULL;
+	struct iov_iter it = *iter;
+	unsigned int pinned = 0;
+	unsigned int offset;
+	unsigned long uaddr;
+	unsigned int i, n;
+	struct page *page;
+	struct iovec iov;
+	size_t left, seg;
+	size_t size;
+	int ret;
 
-	return io_remap_pfn_range(vma, vma->vm_start, vma->vm_pgoff,
-				  vma->vm_end - vma->vm_start,
-				  vma->vm_page_prot);
+	usg->reg = NULL;
 
-}
+	/* Count the pages of all the segments */
+	usg->nr_pages = 0;
+	for (left = len; left; left -= seg) {
+		iov = akida_iter_iovec(&it);
+		seg = min(iov.iov_len, left);
+		if (!seg)
+			return -EINVAL;
 
-static int akida_1000_mmap(struct file *file, struct vm_area_struct *vma)
-{
-	struct akida_dev *akida =
-		container_of(file->private_data, struct akida_dev, miscdev);
-	unsigned long size;
+		uaddr = (unsigned long)iov.iov_base;
+		usg->nr_pages += DIV_ROUND_UP(offset_in_page(uaddr) + seg,
+					      PAGE_SIZE);
+		iov_iter_advance(&it, seg);
+	}
 
-	if (!(pci_resource_flags(akida->pdev, BAR_0) & IORESOURCE_MEM))
-		return -EINVAL;
+	usg->pages = kvmalloc_array(usg->nr_pages, sizeof(*usg->pages),
+				    GFP_KERNEL);
+	if (!usg->pages)
+		return -ENOMEM;
 
-	size = ((pci_resource_len(akida->pdev, BAR_0) - 1) >> PAGE_SHIFT) + 1;
-	if (vma->vm_pgoff + vma_pages(vma) > size)
-		return -EINVAL;
+	ret = sg_alloc_table(&usg->sgt, usg->nr_pages, GFP_KERNEL);
+	if (ret)
+		goto free_pages;
 
-	return akida_mmap(akida, BAR_0, vma);
-}
+	/* Pin the pages of each segment, they are written by the device on
+	 * reads. Physically contiguous pages, even from different segments,
+	 * are merged in a single DMA segment.
+	 */
+	usg->nr_sg = 0;
+	for (left = len; left; left -= seg) {
+		iov = akida_iter_iovec(iter);
+		seg = min(iov.iov_len, left);
+		uaddr = (unsigned long)iov.iov_base;
+		n = DIV_ROUND_UP(offset_in_page(uaddr) + seg, PAGE_SIZE);
+
+		ret = akida_pin_user_pages(uaddr, n, to_user ? FOLL_WRITE : 0,
+					   usg->pages + pinned);
+		if (ret != n) {
+			if (ret > 0)
+				akida_unpin_user_pages(usg->pages + pinned, ret,
+						       false);
+			ret = ret < 0 ? ret : -EFAULT;
+			goto unpin_pages;
+		}
 
-static int akida_1500_mmap(struct file *file, struct vm_area_struct *vma)
-{
-	struct akida_dev *akida =
-		container_of(file->private_data, struct akida_dev, miscdev);
-	unsigned long start [3], size[3];
-	unsigned int bar;
+		offset = offset_in_page(uaddr);
+		size = seg;
+		for (i = 0; i < n; i++) {
+			page = usg->pages[pinned + i];
+			if (sg && sg_phys(sg) + sg->length ==
+				  page_to_phys(page) + offset &&
+			    sg->length <= UINT_MAX - PAGE_SIZE) {
+				sg->length += min_t(size_t, size,
+						    PAGE_SIZE - offset);
+			} else {
+				sg = sg ? sg_next(sg) : usg->sgt.sgl;
+				sg_set_page(sg, page,
+					    min_t(size_t, size, PAGE_SIZE - offset),
+					    offset);
+				usg->nr_sg++;
+			}
+			size -= min_t(size_t, size, PAGE_SIZE - offset);
+			offset = 0;
+		}
+
+		pinned += n;
+		iov_iter_advance(iter, seg);
+	}
+	sg_mark_end(sg);
+
+	/* Map pages, each DMA segment is a burst in the eDMA linked-list */
+	usg->nents = dma_map_sg(dma_chan->chan->device->dev, usg->sgt.sgl,
+				usg->nr_sg, dma_chan->dma_data_dir);
+	if (!usg->nents) {
+		pci_err(akida->pdev, "DMA mapping failed\n");
+		ret = -EINVAL;
+		goto unpin_pages;
+	}
+
+	return 0;
+
+unpin_pages:
+	akida_unpin_user_pages(usg->pages, pinned, false);
+	sg_free_table(&usg->sgt);
+free_pages:
+	kvfree(usg->pages);
+	return ret;
+}
+
+static void akida_user_sg_unmap(struct akida_dma_chan *dma_chan,
+	struct akida_user_sg *usg, bool dirty)
+{
+	struct scatterlist *sg;
+	unsigned int i;
+
+	/* Registered buffers stay pinned and mapped, only give the ownership
+	 * of the transferred part back to the CPU.
+	 */
+	if (usg->reg) {
+		for_each_sg(usg->sgt.sgl, sg, usg->nents, i)
+			dma_sync_single_for_cpu(dma_chan->chan->device->dev,
+						sg_dma_address(sg),
+						sg_dma_len(sg),
+						dma_chan->dma_data_dir);
+		sg_free_table(&usg->sgt);
+		return;
+	}
+
+	dma_unmap_sg(dma_chan->chan->device->dev, usg->sgt.sgl, usg->nr_sg,
+		     dma_chan->dma_data_dir);
+	sg_free_table(&usg->sgt);
+	akida_unpin_user_pages(usg->pages, usg->nr_pages, dirty);
+	kvfree(usg->pages);
+}
+
+/* Build a table of the DMA segments of a DMA mapped scatter-gather list
+ * covering len bytes from off. Only the DMA address and length of the
+ * entries are set.
+ */
+static int akida_sg_dma_slice(struct sg_table *sgt, struct scatterlist *sgl,
+			      unsigned int nents, size_t off, size_t len)
+{
+	struct scatterlist *sg, *dst = NULL;
+	size_t pos, start;
+	unsigned int i, n;
+	int ret;
+
+	n = 0;
+	pos = 0;
+	for_each_sg(sgl, sg, nents, i) {
+		if (pos < off + len && off < pos + sg_dma_len(sg))
+			n++;
+		pos += sg_dma_len(sg);
+	}
+
+	ret = sg_alloc_table(sgt, n, GFP_KERNEL);
+	if (ret)
+		return ret;
+
+	pos = 0;
+	for_each_sg(sgl, sg, nents, i) {
+		if (pos < off + len && off < pos + sg_dma_len(sg)) {
+			start = max(off, pos) - pos;
+			dst = dst ? sg_next(dst) : sgt->sgl;
+			sg_dma_address(dst) = sg_dma_address(sg) + start;
+			sg_dma_len(dst) = min(off + len, pos + sg_dma_len(sg)) -
+					  pos - start;
+		}
+		pos += sg_dma_len(sg);
+	}
+
+	return n;
+}
+
+/* User buffer registered once to be transferred many times: its pages stay
+ * pinned and DMA mapped until it is unregistered.
+ */
+struct akida_regbuf {
+	struct kref ref;
+	struct device *dev;
+	unsigned long uaddr;
+	size_t len;
+	struct page **pages;
+	unsigned int nr_pages;
+	struct sg_table sgt;
+	/* Address space charged for the pinned pages */
+	struct mm_struct *mm;
+};
+
+/* Registered buffer seen by the device at dev_addr, each DMA segment through
+ * its own outbound region. The window is referenced by the slot of each of
+ * its regions in akida->win, index is the first one.
+ */
+struct akida_outwin {
+	struct akida_file *af;
+	struct akida_regbuf *reg;
+	u32 dev_addr;
+	size_t len;
+	unsigned int index;
+};
+
+/* Charge long term pinned pages to mm->pinned_vm, within RLIMIT_MEMLOCK
+ * unless CAP_IPC_LOCK, as io_uring and RDMA do.
+ */
+static int akida_account_pinned(struct mm_struct *mm, unsigned int nr_pages)
+{
+	unsigned long limit = rlimit(RLIMIT_MEMLOCK) >> PAGE_SHIFT;
+	bool unlimited = capable(CAP_IPC_LOCK);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 1, 0)
+	if (atomic64_add_return(nr_pages, &mm->pinned_vm) > limit &&
+	    !unlimited) {
+		atomic64_sub(nr_pages, &mm->pinned_vm);
+		return -ENOMEM;
+	}
+#else
+	int ret = 0;
+
+	down_write(&mm->mmap_sem);
+	if (mm->pinned_vm + nr_pages > limit && !unlimited)
+		ret = -ENOMEM;
+	else
+		mm->pinned_vm += nr_pages;
+	up_write(&mm->mmap_sem);
+	if (ret)
+		return ret;
+#endif
+	return 0;
+}
+
+static void akida_unaccount_pinned(struct mm_struct *mm,
+				   unsigned int nr_pages)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 1, 0)
+	atomic64_sub(nr_pages, &mm->pinned_vm);
+#else
+	down_write(&mm->mmap_sem);
+	mm->pinned_vm -= nr_pages;
+	up_write(&mm->mmap_sem);
+#endif
+}
+
+static struct akida_regbuf *akida_regbuf_create(struct akida_dev *akida,
+						u64 addr, u64 len)
+{
+	unsigned long align = akida_dma_user_align();
+	struct akida_regbuf *reg;
+	int ret;
+
+	/* Aligned on cache lines, as buffers transferred in zero-copy */
+	if (!len || len > MAX_RW_COUNT || !IS_ALIGNED(addr | len, align) ||
+	    !access_ok(u64_to_user_ptr(addr), len))
+		return ERR_PTR(-EINVAL);
+
+	reg = kzalloc(sizeof(*reg), GFP_KERNEL);
+	if (!reg)
+		return ERR_PTR(-ENOMEM);
+
+	kref_init(&reg->ref);
+	/* All the DMA channels belong to the PCI device */
+	reg->dev = &akida->pdev->dev;
+	reg->uaddr = addr;
+	reg->len = len;
+	reg->nr_pages = DIV_ROUND_UP(offset_in_page(addr) + len, PAGE_SIZE);
+
+	reg->pages = kvmalloc_array(reg->nr_pages, sizeof(*reg->pages),
+				    GFP_KERNEL);
+	if (!reg->pages) {
+		ret = -ENOMEM;
+		goto free_reg;
+	}
+
+	ret = akida_account_pinned(current->mm, reg->nr_pages);
+	if (ret)
+		goto free_pages;
+	reg->mm = current->mm;
+	mmgrab(reg->mm);
+
+	/* Pinned for long, the device writes the pages on reads */
+	ret = akida_pin_user_pages(addr, reg->nr_pages,
+				   FOLL_WRITE | FOLL_LONGTERM, reg->pages);
+	if (ret != reg->nr_pages) {
+		if (ret > 0)
+			akida_unpin_user_pages(reg->pages, ret, false);
+		ret = ret < 0 ? ret : -EFAULT;
+		goto unaccount;
+	}
+
+	ret = sg_alloc_table_from_pages(&reg->sgt, reg->pages, reg->nr_pages,
+					offset_in_page(addr), len, GFP_KERNEL);
+	if (ret)
+		goto unpin_pages;
+
+	/* Mapped in both directions, the buffer can be read and written */
+	reg->sgt.nents = dma_map_sg(reg->dev, reg->sgt.sgl,
+				    reg->sgt.orig_nents, DMA_BIDIRECTIONAL);
+	if (!reg->sgt.nents) {
+		pci_err(akida->pdev, "DMA mapping failed\n");
+		ret = -EINVAL;
+		goto free_table;
+	}
+
+	return reg;
+
+free_table:
+	sg_free_table(&reg->sgt);
+unpin_pages:
+	akida_unpin_user_pages(reg->pages, reg->nr_pages, false);
+unaccount:
+	akida_unaccount_pinned(reg->mm, reg->nr_pages);
+	mmdrop(reg->mm);
+free_pages:
+	kvfree(reg->pages);
+free_reg:
+	kfree(reg);
+	return ERR_PTR(ret);
+}
+
+static void akida_regbuf_release(struct kref *ref)
+{
+	struct akida_regbuf *reg = container_of(ref, struct akida_regbuf, ref);
+
+	dma_unmap_sg(reg->dev, reg->sgt.sgl, reg->sgt.orig_nents,
+		     DMA_BIDIRECTIONAL);
+	sg_free_table(&reg->sgt);
+	akida_unpin_user_pages(reg->pages, reg->nr_pages, true);
+	akida_unaccount_pinned(reg->mm, reg->nr_pages);
+	mmdrop(reg->mm);
+	kvfree(reg->pages);
+	kfree(reg);
+}
+
+static void akida_regbuf_put(struct akida_regbuf *reg)
+{
+	if (reg)
+		kref_put(&reg->ref, akida_regbuf_release);
+}
+
+/* Registered buffer at index with a reference taken, or NULL */
+static struct akida_regbuf *akida_regbuf_get(struct akida_file *af,
+					     unsigned int index)
+{
+	struct akida_regbuf *reg = NULL;
+
+	if (index >= AKIDA_BUF_MAX)
+		return NULL;
+
+	spin_lock(&af->bufs_lock);
+	if (af->bufs[index]) {
+		reg = af->bufs[index];
+		kref_get(&reg->ref);
+	}
+	spin_unlock(&af->bufs_lock);
+
+	return reg;
+}
+
+/* Same as akida_user_sg_map() for a part of a registered buffer: no pinning
+ * nor mapping, the caller holds a reference on the buffer.
+ */
+static int akida_regbuf_sg_map(struct akida_dma_chan *dma_chan,
+	struct akida_user_sg *usg, struct akida_regbuf *reg, size_t off,
+	size_t len)
+{
+	struct scatterlist *sg;
+	unsigned int i;
+	int ret;
+
+	ret = akida_sg_dma_slice(&usg->sgt, reg->sgt.sgl, reg->sgt.nents,
+				 off, len);
+	if (ret < 0)
+		return ret;
+
+	usg->nents = ret;
+	usg->reg = reg;
+	for_each_sg(usg->sgt.sgl, sg, usg->nents, i)
+		dma_sync_single_for_device(reg->dev, sg_dma_address(sg),
+					   sg_dma_len(sg),
+					   dma_chan->dma_data_dir);
+	return 0;
+}
+
+/* Transfer from/to a user buffer in zero-copy */
+static int akida_dma_transfer_zero_copy(struct akida_dev *akida,
+	struct akida_dma_chan **chans, unsigned int nr_chans,
+	phys_addr_t dev_addr, struct iov_iter *iter, size_t len)
+{
+	bool to_user = chans[0]->dma_data_dir == DMA_FROM_DEVICE;
+	struct akida_user_sg usg[AKIDA_DMA_CHAN_MAX] = {};
+	struct akida_dma_chan *dma_chan;
+	unsigned int submitted = 0;
+	unsigned int i;
+	size_t part;
+	size_t size;
+	int ret = 0;
+	int err;
+
+	/* One part per channel, all parts are transferred concurrently.
+	 * Parts are page multiples to keep the cache line alignment of the
+	 * buffer.
+	 */
+	part = ALIGN(DIV_ROUND_UP(len, nr_chans), PAGE_SIZE);
+
+	for (i = 0; i < nr_chans && len; i++) {
+		dma_chan = chans[i];
+		size = min(len, part);
+
+		ret = akida_user_sg_map(akida, dma_chan, &usg[i], iter, size);
+		if (ret < 0)
+			break;
+
+		ret = akida_dma_submit_sg(akida, dma_chan, dev_addr,
+					  usg[i].sgt.sgl, usg[i].nents,
+					  &dma_chan->dma_complete);
+		if (ret < 0) {
+			akida_user_sg_unmap(dma_chan, &usg[i], false);
+			break;
+		}
+		submitted++;
+
+		dev_addr += size;
+		len -= size;
+	}
+
+	for (i = 0; i < submitted; i++) {
+		dma_chan = chans[i];
+		err = akida_dma_wait_done(akida, dma_chan,
+					  &dma_chan->dma_complete);
+		if (err < 0 && !ret)
+			ret = err;
+	}
+
+	for (i = 0; i < submitted; i++)
+		akida_user_sg_unmap(chans[i], &usg[i], to_user && !ret);
+
+	return ret;
+}
+
+static int akida_dma_transfer_iter(struct akida_dev *akida,
+	struct akida_dma_chan **chans, unsigned int nr_chans,
+	phys_addr_t dev_addr, struct iov_iter *iter)
+{
+	size_t len = iov_iter_count(iter);
+	void __user *buf = akida_iter_user_buf(iter);
+	unsigned long uaddr = (unsigned long)buf;
+	unsigned long align;
+	size_t head, tail;
+	int ret;
+
+	if (!zero_copy || len < zero_copy_min)
+		return akida_dma_transfer_bounce(akida, chans, nr_chans,
+						 dev_addr, iter, len);
+
+	/* Vectored transfers: all the segments are gathered in a single
+	 * scatter-gather list if they are all aligned, else they are gathered
+	 * in the bounce buffers.
+	 */
+	if (!buf) {
+		if (!akida_iter_is_aligned(iter))
+			return akida_dma_transfer_bounce(akida, chans, nr_chans,
+							 dev_addr, iter, len);
+
+		return akida_dma_transfer_zero_copy(akida, chans, nr_chans,
+						    dev_addr, iter, len);
+	}
+
+	/* Partial cache lines at both ends of the user buffer go through the
+	 * bounce buffer.
+	 */
+	align = akida_dma_user_align();
+	head = ALIGN(uaddr, align) - uaddr;
+	tail = (uaddr + len) - ALIGN_DOWN(uaddr + len, align);
+	if (head + tail + zero_copy_min > len)
+		return akida_dma_transfer_bounce(akida, chans, nr_chans,
+						 dev_addr, iter, len);
+
+	if (head) {
+		ret = akida_dma_transfer_bounce(akida, chans, 1, dev_addr,
+						iter, head);
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = akida_dma_transfer_zero_copy(akida, chans, nr_chans,
+					   dev_addr + head, iter,
+					   len - head - tail);
+	if (ret < 0)
+		return ret;
+
+	if (tail) {
+		ret = akida_dma_transfer_bounce(akida, chans, 1,
+						dev_addr + len - tail,
+						iter, tail);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Return the mapping of a transfer served by programmed I/O, or NULL if the
+ * transfer has to use the DMA.
+ */
+static void __iomem *akida_pio_addr(struct akida_dev *akida,
+				    phys_addr_t addr, size_t len)
+{
+	struct akida_pio_win *win;
+	unsigned int i;
+
+	/* Only 32-bit accesses, device registers may not support others */
+	if (len > READ_ONCE(akida->pio_max) || !IS_ALIGNED(addr | len, 4))
+		return NULL;
+
+	for (i = 0; i < akida->nr_pio_win; i++) {
+		win = &akida->pio_win[i];
+		if (addr >= win->dev_addr &&
+		    addr + len <= win->dev_addr + win->size)
+			return win->base + (addr - win->dev_addr);
+	}
+
+	return NULL;
+}
+
+static int akida_pio_transfer(void __iomem *io, struct iov_iter *iter,
+			      size_t len, bool write)
+{
+	u32 buf[AKIDA_PIO_SIZE_MAX / 4];
+	unsigned int i;
+
+	if (write) {
+		if (copy_from_iter(buf, len, iter) != len)
+			return -EFAULT;
+		for (i = 0; i < len / 4; i++)
+			writel(buf[i], io + i * 4);
+	} else {
+		for (i = 0; i < len / 4; i++)
+			buf[i] = readl(io + i * 4);
+		if (copy_to_iter(buf, len, iter) != len)
+			return -EFAULT;
+	}
+
+	return 0;
+}
+
+/* Whether [addr, end) of the AKD1500 windows address space lies within a
+ * window of the file: the windows of other files map their own buffers.
+ */
+static bool akida_win_is_allowed(struct akida_file *af, u64 addr, u64 end)
+{
+	struct akida_dev *akida = af->akida;
+	struct akida_outwin *w;
+	bool ret = false;
+	unsigned int i;
+
+	mutex_lock(&akida->win_lock);
+	for (i = 0; i < AKIDA_WIN_REGIONS_MAX; i++) {
+		w = akida->win[i];
+		if (w && w->af == af && addr >= w->dev_addr &&
+		    end <= (u64)w->dev_addr + w->len) {
+			ret = true;
+			break;
+		}
+	}
+	mutex_unlock(&akida->win_lock);
+
+	return ret;
+}
+
+/* Whether a user transfer of a file may access [addr, addr + size) of the
+ * device address space. The range is checked as given by the user, before
+ * any truncation to phys_addr_t.
+ */
+static bool akida_is_allowed(struct akida_file *af, u64 addr, u64 size)
+{
+	struct akida_dev *akida = af->akida;
+	u64 start = AKIDA_DMA_RAM_PHY_ADDR + akida->dma_ram.offset;
+	u64 end;
+
+	/* The device address space is 32-bit */
+	if (check_add_overflow(addr, size, &end) || end > BIT_ULL(32))
+		return false;
+
+	/* Overlap with DMA RAM reserved area is not allowed */
+	if (end > start && start + akida->dma_ram.size > addr)
+		return false;
+
+	/* Nor with the linked-lists in host memory, their elements hold host
+	 * DMA addresses.
+	 */
+	if (akida->ll_host.size && end > AKIDA_1500_LL_HOST_BASE &&
+	    AKIDA_1500_LL_HOST_BASE + akida->ll_host.size > addr)
+		return false;
+
+	/* Nor with the windows address space, but in a window of the file */
+	if (akida->mmio_bar0 && end > AKIDA_WIN_DEV_BASE &&
+	    AKIDA_WIN_DEV_BASE + AKIDA_WIN_DEV_SIZE > addr)
+		return akida_win_is_allowed(af, addr, end);
+
+	return true;
+}
+
+static void akida_chan_pool_init(struct akida_chan_pool *pool,
+				 struct akida_dma_chan *chans,
+				 unsigned int nr_chans)
+{
+	unsigned int i;
+
+	BUILD_BUG_ON(AKIDA_DMA_CHAN_MAX > BITS_PER_LONG);
+
+	pool->used = 0;
+	pool->chans = chans;
+	pool->nr_chans = nr_chans;
+	for (i = 0; i < AKIDA_QOS_NR; i++) {
+		init_waitqueue_head(&pool->wq[i]);
+		atomic_set(&pool->waiting[i], 0);
+		atomic_set(&pool->active[i], 0);
+	}
+	for (i = 0; i < nr_chans; i++) {
+		chans[i].pool = pool;
+		chans[i].index = i;
+	}
+}
+
+/* Take a free channel for a transfer of class cls, or return NULL: bulk
+ * transfers give way to the latency ones waiting for a channel.
+ */
+static struct akida_dma_chan *akida_chan_pool_get(struct akida_chan_pool *pool,
+						  unsigned int cls)
+{
+	struct akida_dma_chan *chan;
+	unsigned int i;
+
+	if (cls == AKIDA_QOS_BULK &&
+	    atomic_read(&pool->waiting[AKIDA_QOS_LATENCY]))
+		return NULL;
+
+	do {
+		i = find_first_zero_bit(&pool->used, pool->nr_chans);
+		if (i >= pool->nr_chans)
+			return NULL;
+	} while (test_and_set_bit_lock(i, &pool->used));
+
+	chan = &pool->chans[i];
+	chan->qos_class = cls;
+	atomic_inc(&pool->active[cls]);
+	return chan;
+}
+
+/* Wake a single waiter if a channel is free, a latency class one first */
+static void akida_chan_pool_wake(struct akida_chan_pool *pool)
+{
+	unsigned int cls;
+
+	/* Pairs with the barrier of the waiters between counting themselves
+	 * and checking for a free channel.
+	 */
+	smp_mb__after_atomic();
+
+	if (find_first_zero_bit(&pool->used, pool->nr_chans) >= pool->nr_chans)
+		return;
+
+	if (atomic_read(&pool->waiting[AKIDA_QOS_LATENCY]))
+		cls = AKIDA_QOS_LATENCY;
+	else if (atomic_read(&pool->waiting[AKIDA_QOS_BULK]))
+		cls = AKIDA_QOS_BULK;
+	else
+		return;
+
+	wake_up(&pool->wq[cls]);
+}
+
+/* Acquire a free channel for a transfer of class cls, waiting for one if
+ * needed (unless nowait is set), and up to max - 1 other channels if they
+ * are free as well.
+ * Return the number of channels acquired.
+ */
+static int akida_acquire_chans(struct akida_chan_pool *pool,
+			       struct akida_dma_chan **chans,
+			       unsigned int max, bool nowait,
+			       unsigned int cls)
+{
+	struct akida_dma_chan *chan;
+	unsigned int n = 0;
+	int ret;
+
+	chan = akida_chan_pool_get(pool, cls);
+	if (!chan) {
+		if (nowait)
+			return -EAGAIN;
+
+		atomic_inc(&pool->waiting[cls]);
+		smp_mb__after_atomic();
+		ret = wait_event_interruptible_exclusive(pool->wq[cls],
+			(chan = akida_chan_pool_get(pool, cls)));
+		atomic_dec(&pool->waiting[cls]);
+
+		/* Pass the wake up on: to the next waiter if channels are
+		 * left, or if this one was interrupted.
+		 */
+		akida_chan_pool_wake(pool);
+		if (ret)
+			return ret;
+	}
+
+	do {
+		chans[n++] = chan;
+	} while (n < max && (chan = akida_chan_pool_get(pool, cls)));
+
+	return n;
+}
+
+static void akida_release_chans(struct akida_dma_chan **chans,
+				unsigned int nr_chans)
+{
+	struct akida_chan_pool *pool;
+	unsigned int i;
+
+	for (i = 0; i < nr_chans; i++) {
+		pool = chans[i]->pool;
+		atomic_dec(&pool->active[chans[i]->qos_class]);
+		clear_bit_unlock(chans[i]->index, &pool->used);
+		akida_chan_pool_wake(pool);
+	}
+}
+
+/* Bind a channel of a direction (0 rx, 1 tx) to a file, the bind_lock of
+ * the direction being held. At least one channel of each direction is kept
+ * for the files without binding.
+ */
+static int akida_bind_chan(struct akida_file *af, unsigned int d)
+{
+	struct akida_dev *akida = af->akida;
+	struct akida_dma_chan *chan;
+	int ret;
+
+	if (atomic_inc_return(&akida->nr_bound[d]) >=
+	    akida->chan_pool[d].nr_chans) {
+		atomic_dec(&akida->nr_bound[d]);
+		return -EBUSY;
+	}
+
+	ret = akida_acquire_chans(&akida->chan_pool[d], &chan, 1, false,
+				  READ_ONCE(af->qos_class));
+	if (ret < 0) {
+		atomic_dec(&akida->nr_bound[d]);
+		return ret;
+	}
+
+	af->bound[d] = chan;
+	return 0;
+}
+
+static void akida_unbind_chan(struct akida_file *af, unsigned int d)
+{
+	struct akida_dev *akida = af->akida;
+
+	akida_release_chans(&af->bound[d], 1);
+	af->bound[d] = NULL;
+	atomic_dec(&akida->nr_bound[d]);
+}
+
+/* Return the channel of a direction bound to a file, locked, NULL if the
+ * file has no binding or ERR_PTR(-EAGAIN) if nowait is set and the channel
+ * is in use.
+ */
+static struct akida_dma_chan *akida_bound_chan_lock(struct akida_file *af,
+						    unsigned int d,
+						    bool nowait)
+{
+	if (!af || !READ_ONCE(af->bound[d]))
+		return NULL;
+
+	if (nowait) {
+		if (!mutex_trylock(&af->bind_lock[d]))
+			return ERR_PTR(-EAGAIN);
+	} else if (mutex_lock_interruptible(&af->bind_lock[d])) {
+		return ERR_PTR(-ERESTARTSYS);
+	}
+
+	/* Unbound meanwhile */
+	if (!af->bound[d]) {
+		mutex_unlock(&af->bind_lock[d]);
+		return NULL;
+	}
+
+	return af->bound[d];
+}
+
+static void akida_bound_chan_unlock(struct akida_file *af, unsigned int d)
+{
+	mutex_unlock(&af->bind_lock[d]);
+}
+
+/* Class of a transfer of a file, RWF_HIPRI ones being latency critical */
+static unsigned int akida_qos_class(struct akida_file *af, bool hipri)
+{
+	return hipri ? AKIDA_QOS_LATENCY : READ_ONCE(af->qos_class);
+}
+
+/* Size of the slices a transfer of class cls is split into */
+static size_t akida_qos_slice(unsigned int cls, size_t len)
+{
+	unsigned int slice = READ_ONCE(qos_slice);
+
+	if (cls != AKIDA_QOS_BULK || !slice)
+		return len;
+
+	/* Page multiples keep the alignment of zero-copy buffers */
+	return max_t(size_t, ALIGN_DOWN(slice, PAGE_SIZE), PAGE_SIZE);
+}
+
+/* Whether latency class transfers wait for a channel of a direction */
+static bool akida_qos_preempt(struct akida_chan_pool *pool)
+{
+	return atomic_read(&pool->waiting[AKIDA_QOS_LATENCY]);
+}
+
+/* Number of channels a transfer can be striped over */
+static unsigned int akida_stripe_max(size_t len)
+{
+	if (!stripe_min)
+		return 1;
+
+	return clamp_t(size_t, len / stripe_min, 1, AKIDA_DMA_CHAN_MAX);
+}
+
+/* Asynchronous transfer, from submission to kiocb completion.
+ * The channel is owned by the transfer until it completes.
+ */
+struct akida_aio {
+	struct akida_dev *akida;
+	struct list_head node;
+	struct kiocb *iocb;
+	struct akida_dma_chan *dma_chan;
+	struct akida_user_sg usg;
+	size_t len;
+	long res;
+	struct akida_dma_done done;
+	struct work_struct work;
+};
+
+/* Remove a transfer from the ones in flight, akida may go away once none is
+ * left.
+ */
+static void akida_aio_unlist(struct akida_aio *aio)
+{
+	struct akida_dev *akida = aio->akida;
+
+	spin_lock(&akida->aio_lock);
+	list_del(&aio->node);
+	if (list_empty(&akida->aio_list))
+		wake_up(&akida->aio_wq);
+	spin_unlock(&akida->aio_lock);
+}
+
+static void akida_aio_complete(struct work_struct *work)
+{
+	struct akida_aio *aio = container_of(work, struct akida_aio, work);
+	struct akida_dma_chan *dma_chan = aio->dma_chan;
+	struct kiocb *iocb = aio->iocb;
+
+	/* A timed out transfer may still run until the engine stops */
+	if (aio->res == -ETIMEDOUT)
+		dmaengine_synchronize(dma_chan->chan);
+
+	akida_user_sg_unmap(dma_chan, &aio->usg,
+			    dma_chan->dma_data_dir == DMA_FROM_DEVICE &&
+			    aio->res > 0);
+	if (dma_chan->polled)
+		akida_dma_set_polled(&dma_chan, 1, false);
+	akida_release_chans(&dma_chan, 1);
+	akida_aio_unlist(aio);
+
+	if (aio->res > 0)
+		iocb->ki_pos += aio->res;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 16, 0)
+	iocb->ki_complete(iocb, aio->res, 0);
+#else
+	iocb->ki_complete(iocb, aio->res);
+#endif
+	kfree(aio);
+}
+
+static void akida_aio_callback(void *arg,
+			       const struct dmaengine_result *result)
+{
+	struct akida_aio *aio = arg;
+	int ret = akida_dma_result(result);
+
+	if (ret)
+		aio->res = ret;
+
+	/* Unpinning dirty pages may sleep, complete from process context */
+	schedule_work(&aio->work);
+}
+
+/* Submit the transfer of a kiocb and return -EIOCBQUEUED, the kiocb being
+ * completed from the DMA completion.
+ * Only buffers eligible for zero-copy are transferred asynchronously, others
+ * need the CPU to copy data from/to the bounce buffers: -EOPNOTSUPP is
+ * returned for them.
+ */
+static int akida_aio_submit(struct akida_dev *akida,
+			    struct akida_chan_pool *pool, struct kiocb *iocb,
+			    struct iov_iter *iter, unsigned int cls)
+{
+	size_t len = iov_iter_count(iter);
+	struct akida_aio *aio;
+	int ret;
+
+	if (!zero_copy || len < zero_copy_min || !akida_iter_is_aligned(iter))
+		return -EOPNOTSUPP;
+
+	aio = kzalloc(sizeof(*aio), GFP_KERNEL);
+	if (!aio)
+		return -ENOMEM;
+
+	aio->akida = akida;
+	aio->iocb = iocb;
+	aio->len = len;
+	aio->res = len;
+	INIT_WORK(&aio->work, akida_aio_complete);
+
+	spin_lock(&akida->aio_lock);
+	if (akida->removed) {
+		spin_unlock(&akida->aio_lock);
+		ret = -ENODEV;
+		goto free_aio;
+	}
+	list_add_tail(&aio->node, &akida->aio_list);
+	spin_unlock(&akida->aio_lock);
+
+	ret = akida_acquire_chans(pool, &aio->dma_chan, 1,
+				  iocb->ki_flags & IOCB_NOWAIT, cls);
+	if (ret < 0)
+		goto unlist;
+
+	ret = akida_user_sg_map(akida, aio->dma_chan, &aio->usg, iter, len);
+	if (ret < 0)
+		goto release_chan;
+
+	/* io_uring IOPOLL: the kiocb is completed by akida_iopoll() */
+	if (iocb->ki_flags & IOCB_HIPRI) {
+		akida_dma_set_polled(&aio->dma_chan, 1, true);
+		iocb->private = aio;
+		ret = akida_dma_submit_sg(akida, aio->dma_chan, iocb->ki_pos,
+					  aio->usg.sgt.sgl, aio->usg.nents,
+					  &aio->done);
+	} else {
+		ret = akida_dma_submit_sg_cb(akida, aio->dma_chan,
+					     iocb->ki_pos, aio->usg.sgt.sgl,
+					     aio->usg.nents, akida_aio_callback,
+					     aio);
+	}
+	if (ret < 0)
+		goto unmap;
+
+	return -EIOCBQUEUED;
+
+unmap:
+	iocb->private = NULL;
+	if (aio->dma_chan->polled)
+		akida_dma_set_polled(&aio->dma_chan, 1, false);
+	akida_user_sg_unmap(aio->dma_chan, &aio->usg, false);
+release_chan:
+	akida_release_chans(&aio->dma_chan, 1);
+unlist:
+	akida_aio_unlist(aio);
+free_aio:
+	kfree(aio);
+	return ret;
+}
+
+/* Poll the completion of a kiocb submitted with IOCB_HIPRI.
+ * Each call checks the channel once, io_uring calling it again as needed.
+ * Return the number of completed kiocbs.
+ */
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 16, 0)
+static int akida_iopoll(struct kiocb *iocb, bool spin)
+#else
+static int akida_iopoll(struct kiocb *iocb, struct io_comp_batch *iob,
+			unsigned int flags)
+#endif
+{
+	struct akida_aio *aio = READ_ONCE(iocb->private);
+	struct akida_dma_chan *dma_chan;
+	enum dma_status status;
+
+	if (!aio)
+		return 0;
+
+	dma_chan = aio->dma_chan;
+	akida_dw_edma_poll(dma_chan->chan);
+	status = dma_async_is_tx_complete(dma_chan->chan, aio->done.cookie,
+					  NULL, NULL);
+	if (status != DMA_COMPLETE) {
+		if (ktime_before(ktime_get(),
+				 ktime_add_ms(aio->done.start, 2000)))
+			return 0;
+
+		pci_err(akida_file_dev(iocb->ki_filp)->pdev,
+			"DMA poll completion timed out\n");
+		/* Waited for by akida_aio_complete(), this may not sleep */
+		dmaengine_terminate_async(dma_chan->chan);
+		aio->res = -ETIMEDOUT;
+	}
+
+	/* Only one caller completes the kiocb */
+	if (cmpxchg(&iocb->private, aio, NULL) != aio)
+		return 0;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+	/* Unpinning dirty pages may sleep */
+	if (flags & BLK_POLL_NOSLEEP) {
+		schedule_work(&aio->work);
+		return 1;
+	}
+#endif
+	akida_aio_complete(&aio->work);
+	return 1;
+}
+
+static ssize_t akida_rw_iter(struct kiocb *iocb, struct iov_iter *iter,
+			     bool write)
+{
+	struct akida_file *af = iocb->ki_filp->private_data;
+	struct akida_dev *akida = af->akida;
+	struct akida_chan_pool *pool = &akida->chan_pool[write];
+	struct akida_dma_chan *chans[AKIDA_DMA_CHAN_MAX];
+	size_t sz = iov_iter_count(iter);
+	struct akida_dma_chan *bound;
+	size_t slice, done, n;
+	struct iov_iter part;
+	void __iomem *io;
+	unsigned int cls;
+	bool polled;
+	int nr_chans;
+	int ret;
+
+	if (!akida_is_allowed(af, iocb->ki_pos, sz)) {
+		pci_err(akida->pdev, "dma transfer @0x%llx, %zu bytes not allowed\n",
+			iocb->ki_pos, sz);
+		return -EINVAL;
+	}
+
+	if (!sz)
+		return 0;
+
+	/* Small accesses, e.g. registers, are faster by programmed I/O than
+	 * by setting up a DMA transfer and waiting for its interrupt.
+	 */
+	io = akida_pio_addr(akida, iocb->ki_pos, sz);
+	if (io) {
+		ret = akida_pio_transfer(io, iter, sz, write);
+		if (ret < 0)
+			return ret;
+
+		iocb->ki_pos += sz;
+		return sz;
+	}
+
+	/* Large transfers are not worth a busy CPU, they are only latency
+	 * critical.
+	 */
+	cls = akida_qos_class(af, iocb->ki_flags & IOCB_HIPRI);
+	polled = (iocb->ki_flags & IOCB_HIPRI) && sz <= READ_ONCE(poll_max);
+
+	/* Asynchronous transfers own their channel until they complete, they
+	 * always use the shared channels.
+	 */
+	if (!is_sync_kiocb(iocb)) {
+		ret = akida_aio_submit(akida, pool, iocb, iter, cls);
+		if (ret != -EOPNOTSUPP)
+			return ret;
+	}
+
+	/* A synchronous transfer blocks until it is done */
+	if (iocb->ki_flags & IOCB_NOWAIT)
+		return -EAGAIN;
+
+	/* A file with a bound channel uses it, with no acquisition */
+	bound = akida_bound_chan_lock(af, write, false);
+	if (IS_ERR(bound))
+		return PTR_ERR(bound);
+
+	/* Bulk transfers are split in slices, the channels being given to
+	 * the latency class transfers waiting for them between slices.
+	 */
+	slice = bound ? sz : akida_qos_slice(cls, sz);
+
+	if (bound) {
+		chans[0] = bound;
+		nr_chans = 1;
+	} else {
+		nr_chans = akida_acquire_chans(pool, chans,
+					       akida_stripe_max(min(sz, slice)),
+					       false, cls);
+		if (nr_chans < 0)
+			return nr_chans;
+	}
+
+	for (done = 0; done < sz; done += n) {
+		if (done && akida_qos_preempt(pool)) {
+			akida_release_chans(chans, nr_chans);
+			nr_chans = akida_acquire_chans(pool, chans,
+						       akida_stripe_max(slice),
+						       false, cls);
+			if (nr_chans < 0) {
+				ret = nr_chans;
+				nr_chans = 0;
+				break;
+			}
+		}
+
+		n = min(sz - done, slice);
+		part = *iter;
+		iov_iter_truncate(&part, n);
+
+		/* RWF_HIPRI: busy-poll the completion instead of sleeping
+		 * until the DMA interrupt.
+		 */
+		if (polled)
+			akida_dma_set_polled(chans, nr_chans, true);
+
+		ret = akida_dma_transfer_iter(akida, chans, nr_chans,
+					      iocb->ki_pos + done, &part);
+
+		if (polled)
+			akida_dma_set_polled(chans, nr_chans, false);
+		if (ret < 0)
+			break;
+
+		iov_iter_advance(iter, n);
+	}
+
+	if (bound)
+		akida_bound_chan_unlock(af, write);
+	else if (nr_chans)
+		akida_release_chans(chans, nr_chans);
+
+	/* Report the slices done before an error */
+	if (ret < 0 && !done)
+		return ret;
+
+	iocb->ki_pos += done;
+	return done;
+}
+
+static ssize_t akida_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct akida_dev *akida = akida_file_dev(iocb->ki_filp);
+	ssize_t ret;
+
+	ret = akida_op_begin(akida);
+	if (ret)
+		return ret;
+	ret = akida_rw_iter(iocb, to, false);
+	akida_op_end(akida);
+
+	return ret;
+}
+
+static ssize_t akida_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct akida_dev *akida = akida_file_dev(iocb->ki_filp);
+	ssize_t ret;
+
+	ret = akida_op_begin(akida);
+	if (ret)
+		return ret;
+	ret = akida_rw_iter(iocb, from, true);
+	akida_op_end(akida);
+
+	return ret;
+}
+
+
+/* Transfer of a batch, see AKIDA_IOCTL_XFER */
+struct akida_batch_op {
+	struct akida_xfer xfer;
+	struct akida_batch_chan *bc;
+	struct iovec iov;
+	struct iov_iter iter;
+	struct akida_user_sg usg;
+	/* Registered buffer with AKIDA_XFER_FIXED_BUF, reference held */
+	struct akida_regbuf *reg;
+	size_t reg_off;
+	struct akida_dma_buf *bounce;
+	size_t bounce_off;
+	/* Error reported by the DMA callback */
+	int dma_status;
+	bool zero_copy;
+	bool submitted;
+};
+
+/* Channel running transfers of a batch.
+ * Transfers are submitted by rounds, one descriptor per transfer, and the
+ * channel is waited for once per round.
+ */
+struct akida_batch_chan {
+	struct akida_dma_chan *dma_chan;
+	atomic_t pending;
+	struct completion done;
+	unsigned int first;
+	unsigned int next;
+};
+
+static void akida_batch_callback(void *arg,
+				 const struct dmaengine_result *result)
+{
+	struct akida_batch_op *op = arg;
+	struct akida_batch_chan *bc = op->bc;
+
+	op->dma_status = akida_dma_result(result);
+	if (atomic_dec_and_test(&bc->pending))
+		complete(&bc->done);
+}
+
+static int akida_batch_submit_op(struct akida_dev *akida,
+				 struct akida_batch_chan *bc,
+				 struct akida_batch_op *op,
+				 size_t *bounce_used)
+{
+	struct scatterlist bounce_sgl[AKIDA_DMA_BOUNCE_BLOCKS_MAX], *sgl;
+	struct akida_dma_chan *dma_chan = bc->dma_chan;
+	unsigned long align = akida_dma_user_align();
+	size_t len = op->xfer.len;
+	unsigned int nents;
+	unsigned int i;
+	size_t off;
+	int ret;
+
+	if (op->reg || (zero_copy && len >= zero_copy_min &&
+			akida_iter_is_aligned(&op->iter))) {
+		if (op->reg)
+			ret = akida_regbuf_sg_map(dma_chan, &op->usg, op->reg,
+						  op->reg_off, len);
+		else
+			ret = akida_user_sg_map(akida, dma_chan, &op->usg,
+						&op->iter, len);
+		if (ret < 0)
+			return ret;
+
+		op->zero_copy = true;
+		sgl = op->usg.sgt.sgl;
+		nents = op->usg.nents;
+	} else {
+		/* Small transfers are packed in the bounce buffers */
+		for (i = 0; i < AKIDA_DMA_BOUNCE_NR; i++) {
+			off = ALIGN(bounce_used[i], align);
+			if (off + len <= dma_chan->bounce[i].size)
+				break;
+		}
+		if (i == AKIDA_DMA_BOUNCE_NR)
+			return -ENOSPC;
+
+		op->zero_copy = false;
+		op->bounce = &dma_chan->bounce[i];
+		op->bounce_off = off;
+
+		if (dma_chan->dma_data_dir == DMA_TO_DEVICE) {
+			ret = akida_bounce_copy(op->bounce, off, len,
+						&op->iter, false);
+			if (ret)
+				return ret;
+		}
+
+		akida_bounce_sync(dma_chan, op->bounce, off, len, true);
+		bounce_used[i] = off + len;
+
+		sgl = bounce_sgl;
+		nents = akida_bounce_sg(op->bounce, off, len, sgl);
+	}
+
+	op->dma_status = 0;
+	atomic_inc(&bc->pending);
+	ret = akida_dma_submit_sg_cb(akida, dma_chan, op->xfer.dev_addr,
+				     sgl, nents, akida_batch_callback, op);
+	if (ret < 0) {
+		atomic_dec(&bc->pending);
+		if (op->zero_copy)
+			akida_user_sg_unmap(dma_chan, &op->usg, false);
+		return ret;
+	}
+
+	op->submitted = true;
+	return 0;
+}
+
+/* Submit the next transfers of a channel, until its bounce buffers are full */
+static void akida_batch_submit(struct akida_dev *akida,
+			       struct akida_batch_chan *bc,
+			       struct akida_batch_op *ops, unsigned int nr_ops)
+{
+	size_t bounce_used[AKIDA_DMA_BOUNCE_NR] = {0};
+	unsigned int submitted = 0;
+	struct akida_batch_op *op;
+	int ret;
+
+	atomic_set(&bc->pending, 1);
+	reinit_completion(&bc->done);
+	bc->first = bc->next;
+
+	for (; bc->next < nr_ops; bc->next++) {
+		op = &ops[bc->next];
+		if (op->bc != bc || !op->xfer.len)
+			continue;
+
+		ret = akida_batch_submit_op(akida, bc, op, bounce_used);
+		if (ret == -ENOSPC && submitted)
+			break;
+
+		/* Too large for the bounce buffers, done on its own */
+		if (ret == -ENOSPC)
+			ret = akida_dma_transfer_iter(akida, &bc->dma_chan, 1,
+						      op->xfer.dev_addr,
+						      &op->iter);
+		if (ret < 0)
+			op->xfer.status = ret;
+		else if (op->submitted)
+			submitted++;
+	}
+
+	if (atomic_dec_and_test(&bc->pending))
+		complete(&bc->done);
+}
+
+/* Wait for the transfers of the current round of a channel */
+static void akida_batch_complete(struct akida_dev *akida,
+				 struct akida_batch_chan *bc,
+				 struct akida_batch_op *ops)
+{
+	struct akida_dma_chan *dma_chan = bc->dma_chan;
+	bool to_user = dma_chan->dma_data_dir == DMA_FROM_DEVICE;
+	struct akida_batch_op *op;
+	unsigned int i;
+	size_t len;
+	int ret, status;
+
+	ret = akida_dma_wait(akida, dma_chan, &bc->done);
+
+	for (i = bc->first; i < bc->next; i++) {
+		op = &ops[i];
+		if (op->bc != bc || !op->submitted)
+			continue;
+		op->submitted = false;
+		len = op->xfer.len;
+		status = ret ? ret : op->dma_status;
+
+		if (op->zero_copy) {
+			akida_user_sg_unmap(dma_chan, &op->usg,
+					    to_user && !status);
+			op->xfer.status = status;
+			continue;
+		}
+
+		akida_bounce_sync(dma_chan, op->bounce, op->bounce_off, len,
+				  false);
+		op->xfer.status = status;
+		if (!status && to_user)
+			op->xfer.status = akida_bounce_copy(op->bounce,
+							    op->bounce_off,
+							    len, &op->iter,
+							    true);
+	}
+}
+
+/* Check a transfer of a batch and prepare its user buffer iterator, or take
+ * a reference on its registered buffer. The reference is dropped by
+ * akida_batch_run(), or by akida_batch_put_regs() if the batch is not run.
+ */
+static int akida_batch_prepare(struct akida_file *af,
+			       struct akida_batch_op *op)
+{
+	bool to_dev = op->xfer.dir == AKIDA_XFER_TO_DEV;
+	struct akida_regbuf *reg;
+
+	op->bc = NULL;
+	op->reg = NULL;
+	op->submitted = false;
+	op->xfer.status = 0;
+
+	if ((op->xfer.dir != AKIDA_XFER_TO_DEV &&
+	     op->xfer.dir != AKIDA_XFER_FROM_DEV) ||
+	    (op->xfer.flags & ~AKIDA_XFER_FIXED_BUF) ||
+	    op->xfer.len > MAX_RW_COUNT ||
+	    !akida_is_allowed(af, op->xfer.dev_addr, op->xfer.len))
+		goto invalid;
+
+	/* A registered buffer is only used when selected by its index */
+	if (op->xfer.flags & AKIDA_XFER_FIXED_BUF) {
+		reg = akida_regbuf_get(af, op->xfer.buf_index);
+		if (!reg)
+			goto invalid;
+		if (op->xfer.user_addr > reg->len ||
+		    op->xfer.len > reg->len - op->xfer.user_addr) {
+			akida_regbuf_put(reg);
+			goto invalid;
+		}
+		op->reg = reg;
+		op->reg_off = op->xfer.user_addr;
+		return 0;
+	}
+
+	if (op->xfer.buf_index ||
+	    !access_ok(u64_to_user_ptr(op->xfer.user_addr), op->xfer.len))
+		goto invalid;
+
+	op->iov.iov_base = u64_to_user_ptr(op->xfer.user_addr);
+	op->iov.iov_len = op->xfer.len;
+	iov_iter_init(&op->iter, to_dev ? WRITE : READ, &op->iov, 1,
+		      op->xfer.len);
+	return 0;
+
+invalid:
+	op->xfer.status = -EINVAL;
+	return -EINVAL;
+}
+
+static void akida_batch_put_regs(struct akida_batch_op *ops,
+				 unsigned int nr_ops)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_ops; i++) {
+		akida_regbuf_put(ops[i].reg);
+		ops[i].reg = NULL;
+	}
+}
+
+/* Run the prepared transfers of a batch, the ones with an error status are
+ * skipped. The status of each transfer is updated, and the references on
+ * their registered buffers are dropped.
+ * Channels are acquired for the transfer class cls.
+ */
+static int akida_batch_run(struct akida_dev *akida, struct akida_file *af,
+			   struct akida_batch_op *ops, unsigned int nr_ops,
+			   unsigned int cls)
+{
+	struct akida_batch_chan bcs[2][AKIDA_DMA_CHAN_MAX] = {};
+	struct akida_dma_chan *chans[2][AKIDA_DMA_CHAN_MAX];
+	struct akida_dma_chan *bound[2] = {};
+	unsigned int nr_dir_ops[2] = {0};
+	int nr_chans[2] = {0};
+	struct akida_batch_op *op;
+	unsigned int i, d;
+	bool busy;
+	int ret;
+
+	/* Index 0 is the rx (device to host) direction, 1 is the tx one */
+	for (i = 0; i < nr_ops; i++) {
+		op = &ops[i];
+		d = op->xfer.dir == AKIDA_XFER_TO_DEV;
+		if (op->xfer.len && !op->xfer.status)
+			nr_dir_ops[d]++;
+	}
+
+	/* Take free channels of both directions, rx ones first so that
+	 * concurrent batches do not deadlock. A file with a bound channel
+	 * uses it instead.
+	 */
+	for (d = 0; d < 2; d++) {
+		if (!nr_dir_ops[d])
+			continue;
+
+		bound[d] = akida_bound_chan_lock(af, d, false);
+		if (IS_ERR(bound[d])) {
+			ret = PTR_ERR(bound[d]);
+			bound[d] = NULL;
+			goto release_chans;
+		}
+		if (bound[d]) {
+			chans[d][0] = bound[d];
+			nr_chans[d] = 1;
+			continue;
+		}
+
+		nr_chans[d] = akida_acquire_chans(&akida->chan_pool[d],
+						  chans[d],
+						  min_t(unsigned int, nr_dir_ops[d],
+							AKIDA_DMA_CHAN_MAX),
+						  false, cls);
+		if (nr_chans[d] < 0) {
+			ret = nr_chans[d];
+			nr_chans[d] = 0;
+			goto release_chans;
+		}
+	}
+
+	for (d = 0; d < 2; d++) {
+		for (i = 0; i < nr_chans[d]; i++) {
+			bcs[d][i].dma_chan = chans[d][i];
+			init_completion(&bcs[d][i].done);
+		}
+	}
+
+	/* Spread the transfers of each direction over its channels */
+	nr_dir_ops[0] = nr_dir_ops[1] = 0;
+	for (i = 0; i < nr_ops; i++) {
+		op = &ops[i];
+		d = op->xfer.dir == AKIDA_XFER_TO_DEV;
+		if (!op->xfer.len || op->xfer.status)
+			continue;
+		op->bc = &bcs[d][nr_dir_ops[d]++ % nr_chans[d]];
+	}
+
+	/* Run the transfers on all the channels concurrently */
+	do {
+		busy = false;
+		for (d = 0; d < 2; d++)
+			for (i = 0; i < nr_chans[d]; i++)
+				akida_batch_submit(akida, &bcs[d][i], ops,
+						   nr_ops);
+
+		for (d = 0; d < 2; d++) {
+			for (i = 0; i < nr_chans[d]; i++) {
+				akida_batch_complete(akida, &bcs[d][i], ops);
+				if (bcs[d][i].next < nr_ops)
+					busy = true;
+			}
+		}
+	} while (busy);
+
+	ret = 0;
+
+release_chans:
+	for (d = 2; d-- > 0;) {
+		if (bound[d])
+			akida_bound_chan_unlock(af, d);
+		else if (nr_chans[d])
+			akida_release_chans(chans[d], nr_chans[d]);
+	}
+	akida_batch_put_regs(ops, nr_ops);
+
+	return ret;
+}
+
+static long akida_ioctl_xfer(struct akida_file *af,
+			     struct akida_xfer_list __user *arg)
+{
+	struct akida_dev *akida = af->akida;
+	struct akida_xfer __user *uxfers;
+	struct akida_xfer_list list;
+	struct akida_batch_op *ops;
+	unsigned int i;
+	long ret;
+
+	if (copy_from_user(&list, arg, sizeof(list)))
+		return -EFAULT;
+
+	if ((list.flags & ~AKIDA_XFER_LIST_LATENCY) || !list.nr_xfers ||
+	    list.nr_xfers > AKIDA_XFER_MAX)
+		return -EINVAL;
+
+	ops = kvcalloc(list.nr_xfers, sizeof(*ops), GFP_KERNEL);
+	if (!ops)
+		return -ENOMEM;
+
+	/* Check all the transfers before starting any of them */
+	uxfers = u64_to_user_ptr(list.xfers);
+	ret = 0;
+	for (i = 0; i < list.nr_xfers; i++) {
+		if (copy_from_user(&ops[i].xfer, &uxfers[i],
+				   sizeof(ops[i].xfer))) {
+			ret = -EFAULT;
+			goto free_ops;
+		}
+
+		if (akida_batch_prepare(af, &ops[i]) < 0)
+			ret = -EINVAL;
+	}
+	if (ret < 0)
+		goto put_status;
+
+	ret = akida_batch_run(akida, af, ops, list.nr_xfers,
+			      akida_qos_class(af, list.flags &
+					      AKIDA_XFER_LIST_LATENCY));
+	if (ret < 0)
+		goto free_ops;
+
+	for (i = 0; i < list.nr_xfers && !ret; i++)
+		ret = ops[i].xfer.status;
+
+put_status:
+	for (i = 0; i < list.nr_xfers; i++) {
+		if (put_user(ops[i].xfer.status, &uxfers[i].status)) {
+			ret = -EFAULT;
+			break;
+		}
+	}
+free_ops:
+	/* References of a batch not run */
+	akida_batch_put_regs(ops, list.nr_xfers);
+	kvfree(ops);
+	return ret;
+}
+
+/* Submission and completion rings, see AKIDA_IOCTL_RING_SETUP.
+ * Transfers are consumed from the submission ring by batches.
+ */
+#define AKIDA_RING_BATCH_MAX  64
+
+struct akida_ring {
+	struct akida_dev *akida;
+	struct akida_file *af;
+	struct akida_ring_hdr *hdr;
+	struct akida_sqe *sqes;
+	struct akida_cqe *cqes;
+	size_t size;
+	u32 sq_entries;
+	u32 cq_entries;
+	/* Private copies of the indexes written by the driver */
+	u32 sq_head;
+	u32 cq_tail;
+	struct akida_batch_op ops[AKIDA_RING_BATCH_MAX];
+	u64 user_data[AKIDA_RING_BATCH_MAX];
+	wait_queue_head_t cq_wait;
+	/* Submission ring polling thread */
+	struct task_struct *sq_thread;
+	wait_queue_head_t sq_wait;
+	unsigned long sq_idle;
+	struct mm_struct *mm;
+};
+
+/* Number of entries that can be consumed from the submission ring: the
+ * completion ring must have room for their completion.
+ */
+static u32 akida_ring_sq_ready(struct akida_ring *ring)
+{
+	struct akida_ring_hdr *hdr = ring->hdr;
+	u32 sq_ready, cq_used;
+
+	sq_ready = smp_load_acquire(&hdr->sq_tail) - ring->sq_head;
+	cq_used = ring->cq_tail - READ_ONCE(hdr->cq_head);
+
+	/* Indexes are written by userspace, do not trust them */
+	if (sq_ready > ring->sq_entries || cq_used > ring->cq_entries)
+		return 0;
+
+	return min(sq_ready, ring->cq_entries - cq_used);
+}
+
+static u32 akida_ring_cq_ready(struct akida_ring *ring)
+{
+	return ring->cq_tail - READ_ONCE(ring->hdr->cq_head);
+}
+
+/* Consume up to max entries from the submission ring, run them and post
+ * their completion. Return the number of entries consumed.
+ */
+static u32 akida_ring_submit(struct akida_ring *ring, u32 max)
+{
+	struct akida_ring_hdr *hdr = ring->hdr;
+	struct akida_batch_op *op;
+	struct akida_sqe *sqe;
+	struct akida_cqe *cqe;
+	u32 nr, i;
+	int ret;
+
+	nr = min3(akida_ring_sq_ready(ring), max, (u32)AKIDA_RING_BATCH_MAX);
+	if (!nr)
+		return 0;
+
+	for (i = 0; i < nr; i++) {
+		sqe = &ring->sqes[(ring->sq_head + i) & (ring->sq_entries - 1)];
+		op = &ring->ops[i];
+		op->xfer.dev_addr = READ_ONCE(sqe->dev_addr);
+		op->xfer.user_addr = READ_ONCE(sqe->user_addr);
+		op->xfer.len = READ_ONCE(sqe->len);
+		op->xfer.dir = READ_ONCE(sqe->dir);
+		op->xfer.flags = READ_ONCE(sqe->flags);
+		op->xfer.buf_index = READ_ONCE(sqe->buf_index);
+		ring->user_data[i] = READ_ONCE(sqe->user_data);
+
+		if (READ_ONCE(sqe->resv))
+			op->xfer.dir = 0;
+		akida_batch_prepare(ring->af, op);
+	}
+
+	/* The entries can be reused by userspace */
+	ring->sq_head += nr;
+	smp_store_release(&hdr->sq_head, ring->sq_head);
+
+	ret = akida_batch_run(ring->akida, ring->af, ring->ops, nr,
+			      akida_qos_class(ring->af, false));
+
+	for (i = 0; i < nr; i++) {
+		op = &ring->ops[i];
+		cqe = &ring->cqes[(ring->cq_tail + i) & (ring->cq_entries - 1)];
+		cqe->user_data = ring->user_data[i];
+		cqe->flags = 0;
+		if (ret < 0)
+			cqe->res = ret;
+		else
+			cqe->res = op->xfer.status ? op->xfer.status : op->xfer.len;
+	}
+
+	ring->cq_tail += nr;
+	smp_store_release(&hdr->cq_tail, ring->cq_tail);
+	wake_up_all(&ring->cq_wait);
+
+	return nr;
+}
+
+static void akida_ring_use_mm(struct mm_struct *mm)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 8, 0)
+	use_mm(mm);
+	set_fs(USER_DS);
+#else
+	kthread_use_mm(mm);
+#endif
+}
+
+static void akida_ring_unuse_mm(struct mm_struct *mm)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 8, 0)
+	unuse_mm(mm);
+#else
+	kthread_unuse_mm(mm);
+#endif
+}
+
+static int akida_ring_sq_thread(void *data)
+{
+	struct akida_ring *ring = data;
+	struct akida_ring_hdr *hdr = ring->hdr;
+	unsigned long timeout = jiffies + ring->sq_idle;
+	DEFINE_WAIT(wait);
+
+	while (!kthread_should_stop()) {
+		if (akida_ring_sq_ready(ring)) {
+			/* Nor once the device is removed */
+			if (akida_op_begin(ring->akida))
+				break;
+			/* The address space is only borrowed while there is
+			 * work, the thread must not keep it alive. Once the
+			 * owner is exiting nothing can be submitted anymore.
+			 */
+			if (!mmget_not_zero(ring->mm)) {
+				akida_op_end(ring->akida);
+				break;
+			}
+			akida_ring_use_mm(ring->mm);
+			akida_ring_submit(ring, ring->sq_entries);
+			akida_ring_unuse_mm(ring->mm);
+			mmput(ring->mm);
+			akida_op_end(ring->akida);
+			timeout = jiffies + ring->sq_idle;
+			continue;
+		}
+
+		if (time_before(jiffies, timeout)) {
+			cond_resched();
+			continue;
+		}
+
+		/* Idle, sleep until AKIDA_RING_ENTER_SQ_WAKEUP */
+		prepare_to_wait(&ring->sq_wait, &wait, TASK_INTERRUPTIBLE);
+		WRITE_ONCE(hdr->sq_flags, AKIDA_RING_SQ_NEED_WAKEUP);
+		smp_mb();
+		if (!akida_ring_sq_ready(ring) && !kthread_should_stop())
+			schedule();
+		WRITE_ONCE(hdr->sq_flags, 0);
+		finish_wait(&ring->sq_wait, &wait);
+		timeout = jiffies + ring->sq_idle;
+	}
+
+	/* Sleep until akida_ring_stop(), kthread_stop() needs the thread */
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+/* Stop the submission ring polling thread, on close or on the device
+ * removal.
+ */
+static void akida_ring_stop(struct akida_ring *ring)
+{
+	if (ring->sq_thread) {
+		kthread_stop(ring->sq_thread);
+		mmdrop(ring->mm);
+		ring->sq_thread = NULL;
+	}
+}
+
+static void akida_ring_destroy(struct akida_ring *ring)
+{
+	akida_ring_stop(ring);
+	vfree(ring->hdr);
+	kvfree(ring);
+}
+
+static long akida_ioctl_ring_setup(struct akida_file *af,
+				   struct akida_ring_params __user *arg)
+{
+	struct akida_dev *akida = af->akida;
+	struct akida_ring_params params;
+	struct akida_ring *ring;
+	size_t sqes_off, cqes_off;
+	long ret;
+
+	if (copy_from_user(&params, arg, sizeof(params)))
+		return -EFAULT;
+
+	if (!params.cq_entries)
+		params.cq_entries = 2 * params.sq_entries;
+
+	if ((params.flags & ~AKIDA_RING_SETUP_SQPOLL) ||
+	    !is_power_of_2(params.sq_entries) ||
+	    params.sq_entries > AKIDA_RING_ENTRIES_MAX ||
+	    !is_power_of_2(params.cq_entries) ||
+	    params.cq_entries < params.sq_entries ||
+	    params.cq_entries > 2 * AKIDA_RING_ENTRIES_MAX)
+		return -EINVAL;
+
+	/* As io_uring, a polling thread is only granted to privileged users */
+	if ((params.flags & AKIDA_RING_SETUP_SQPOLL) && !capable(CAP_SYS_NICE))
+		return -EPERM;
+
+	mutex_lock(&af->lock);
+	if (af->ring) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+
+	ring = kvzalloc(sizeof(*ring), GFP_KERNEL);
+	if (!ring) {
+		ret = -ENOMEM;
+		goto unlock;
+	}
+	ring->akida = akida;
+	ring->af = af;
+	ring->sq_entries = params.sq_entries;
+	ring->cq_entries = params.cq_entries;
+	init_waitqueue_head(&ring->cq_wait);
+	init_waitqueue_head(&ring->sq_wait);
+
+	sqes_off = ALIGN(sizeof(*ring->hdr), SMP_CACHE_BYTES);
+	cqes_off = ALIGN(sqes_off + ring->sq_entries * sizeof(*ring->sqes),
+			 SMP_CACHE_BYTES);
+	ring->size = PAGE_ALIGN(cqes_off + ring->cq_entries * sizeof(*ring->cqes));
+
+	ring->hdr = vmalloc_user(ring->size);
+	if (!ring->hdr) {
+		kvfree(ring);
+		ret = -ENOMEM;
+		goto unlock;
+	}
+	ring->sqes = (void *)ring->hdr + sqes_off;
+	ring->cqes = (void *)ring->hdr + cqes_off;
+	ring->hdr->sq_mask = ring->sq_entries - 1;
+	ring->hdr->cq_mask = ring->cq_entries - 1;
+	ring->hdr->sqes_off = sqes_off;
+	ring->hdr->cqes_off = cqes_off;
+
+	if (params.flags & AKIDA_RING_SETUP_SQPOLL) {
+		ring->sq_idle = msecs_to_jiffies(params.sq_thread_idle ?
+						 params.sq_thread_idle : 1000);
+		ring->mm = current->mm;
+		mmgrab(ring->mm);
+		ring->sq_thread = kthread_run(akida_ring_sq_thread, ring,
+					      "akida%d-sq", akida->devno);
+		if (IS_ERR(ring->sq_thread)) {
+			ret = PTR_ERR(ring->sq_thread);
+			ring->sq_thread = NULL;
+			mmdrop(ring->mm);
+			akida_ring_destroy(ring);
+			goto unlock;
+		}
+	}
+
+	params.size = ring->size;
+	if (copy_to_user(arg, &params, sizeof(params))) {
+		akida_ring_destroy(ring);
+		ret = -EFAULT;
+		goto unlock;
+	}
+
+	smp_store_release(&af->ring, ring);
+	ret = 0;
+unlock:
+	mutex_unlock(&af->lock);
+	return ret;
+}
+
+static long akida_ioctl_ring_enter(struct akida_file *af,
+				   struct akida_ring_enter __user *arg)
+{
+	struct akida_ring_enter enter;
+	struct akida_ring *ring;
+	u32 submitted = 0;
+	u32 n;
+	int ret;
+
+	if (copy_from_user(&enter, arg, sizeof(enter)))
+		return -EFAULT;
+
+	if (enter.resv || (enter.flags & ~(AKIDA_RING_ENTER_GETEVENTS |
+					   AKIDA_RING_ENTER_SQ_WAKEUP)))
+		return -EINVAL;
+
+	/* The completions are waited for out of the remove lock, the
+	 * removal wakes the waiters up.
+	 */
+	ret = akida_op_begin(af->akida);
+	if (ret)
+		return ret;
+
+	ring = smp_load_acquire(&af->ring);
+	if (!ring) {
+		akida_op_end(af->akida);
+		return -EINVAL;
+	}
+
+	if (ring->sq_thread) {
+		if (enter.flags & AKIDA_RING_ENTER_SQ_WAKEUP)
+			wake_up(&ring->sq_wait);
+	} else if (enter.to_submit) {
+		mutex_lock(&af->lock);
+		while (submitted < enter.to_submit) {
+			n = akida_ring_submit(ring, enter.to_submit - submitted);
+			if (!n)
+				break;
+			submitted += n;
+		}
+		mutex_unlock(&af->lock);
+	}
+	akida_op_end(af->akida);
+
+	if (enter.flags & AKIDA_RING_ENTER_GETEVENTS) {
+		ret = wait_event_interruptible(ring->cq_wait,
+			akida_ring_cq_ready(ring) >= min(enter.min_complete,
+							 ring->cq_entries) ||
+			READ_ONCE(af->akida->removed));
+		if (ret && !submitted)
+			return ret;
+	}
+
+	return submitted;
+}
+
+static int akida_ring_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct akida_file *af = file->private_data;
+	struct akida_ring *ring = smp_load_acquire(&af->ring);
+
+	if (!ring || vma->vm_end - vma->vm_start > ring->size)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ring->hdr, 0);
+}
+
+static void akida_host_ddr_release(struct kref *ref)
+{
+	struct akida_host_ddr *ddr = container_of(ref, struct akida_host_ddr,
+						  ref);
+	struct akida_host_ddr_chunk *c;
+	unsigned int j;
+
+	for (j = 0; j < ddr->nr_chunks; j++) {
+		c = &ddr->chunk[j];
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+		if (ddr->cached) {
+			dma_free_pages(&ddr->pdev->dev, c->size, c->page,
+				       c->dma_addr, DMA_BIDIRECTIONAL);
+			continue;
+		}
+#endif
+		dma_free_attrs(&ddr->pdev->dev, c->size, c->cpu_addr,
+			       c->dma_addr, AKIDA_1500_HOST_DDR_DMA_ATTRS);
+	}
+	pci_dev_put(ddr->pdev);
+	kfree(ddr);
+}
+
+static void akida_host_ddr_put(struct akida_host_ddr *ddr)
+{
+	kref_put(&ddr->ref, akida_host_ddr_release);
+}
+
+/* Slice of the host DDR area exported as a dma-buf */
+struct akida_dmabuf {
+	struct akida_host_ddr *ddr;
+	size_t offset;
+	size_t size;
+};
+
+/* Part of a host DDR chunk within [offset, offset + size) of the area:
+ * return its length, 0 if none, and its offset in the chunk in start.
+ */
+static size_t akida_host_ddr_chunk_part(const struct akida_host_ddr_chunk *c,
+					size_t offset, size_t size,
+					size_t *start)
+{
+	size_t lo = max(offset, c->offset);
+	size_t hi = min(offset + size, c->offset + c->size);
+
+	if (lo >= hi)
+		return 0;
+
+	*start = lo - c->offset;
+	return hi - lo;
+}
+
+/* Build the sg_table of a slice of the host DDR area, not DMA mapped */
+static int akida_host_ddr_get_sgtable(struct akida_host_ddr *ddr,
+	struct sg_table *sgt, size_t offset, size_t size)
+{
+	struct sg_table full[AKIDA_1500_HOST_DDR_CHUNKS_MAX] = {};
+	struct scatterlist *sg, *dst = NULL;
+	struct akida_host_ddr_chunk *c;
+	size_t pos, start, len;
+	unsigned int i, j, n;
+	int ret = 0;
+
+	/* Pages of the chunks within the slice */
+	for (j = 0; j < ddr->nr_chunks; j++) {
+		c = &ddr->chunk[j];
+		if (!akida_host_ddr_chunk_part(c, offset, size, &start))
+			continue;
+
+		if (ddr->cached) {
+			ret = sg_alloc_table(&full[j], 1, GFP_KERNEL);
+			if (!ret)
+				sg_set_page(full[j].sgl, c->page, c->size, 0);
+		} else {
+			ret = dma_get_sgtable_attrs(&ddr->pdev->dev, &full[j],
+						    c->cpu_addr, c->dma_addr,
+						    c->size,
+						    AKIDA_1500_HOST_DDR_DMA_ATTRS);
+		}
+		if (ret)
+			goto free_full;
+	}
+
+	/* Count then copy the parts of the entries within the slice */
+	n = 0;
+	for (j = 0; j < ddr->nr_chunks; j++) {
+		pos = ddr->chunk[j].offset;
+		for_each_sg(full[j].sgl, sg, full[j].orig_nents, i) {
+			if (pos < offset + size && offset < pos + sg->length)
+				n++;
+			pos += sg->length;
+		}
+	}
+
+	ret = sg_alloc_table(sgt, n, GFP_KERNEL);
+	if (ret)
+		goto free_full;
+
+	for (j = 0; j < ddr->nr_chunks; j++) {
+		pos = ddr->chunk[j].offset;
+		for_each_sg(full[j].sgl, sg, full[j].orig_nents, i) {
+			if (pos < offset + size && offset < pos + sg->length) {
+				start = sg->offset + max(offset, pos) - pos;
+				len = min(offset + size, pos + sg->length) -
+				      max(offset, pos);
+				dst = dst ? sg_next(dst) : sgt->sgl;
+				sg_set_page(dst, nth_page(sg_page(sg),
+							  start >> PAGE_SHIFT),
+					    len, offset_in_page(start));
+			}
+			pos += sg->length;
+		}
+	}
+
+free_full:
+	for (j = 0; j < ddr->nr_chunks; j++)
+		sg_free_table(&full[j]);
+	return ret;
+}
+
+/* Cache maintenance of [offset, offset + size) of a cacheable area */
+static void akida_host_ddr_sync(struct akida_host_ddr *ddr, size_t offset,
+				size_t size, enum dma_data_direction dir,
+				bool for_device)
+{
+	struct akida_host_ddr_chunk *c;
+	size_t start, len;
+	unsigned int j;
+
+	for (j = 0; j < ddr->nr_chunks; j++) {
+		c = &ddr->chunk[j];
+		len = akida_host_ddr_chunk_part(c, offset, size, &start);
+		if (!len)
+			continue;
+
+		if (for_device)
+			dma_sync_single_range_for_device(&ddr->pdev->dev,
+							 c->dma_addr, start,
+							 len, dir);
+		else
+			dma_sync_single_range_for_cpu(&ddr->pdev->dev,
+						      c->dma_addr, start, len,
+						      dir);
+	}
+}
+
+static struct sg_table *akida_dmabuf_map(struct dma_buf_attachment *attach,
+					 enum dma_data_direction dir)
+{
+	struct akida_dmabuf *adb = attach->dmabuf->priv;
+	struct sg_table *sgt;
+	int ret;
+
+	sgt = kzalloc(sizeof(*sgt), GFP_KERNEL);
+	if (!sgt)
+		return ERR_PTR(-ENOMEM);
+
+	ret = akida_host_ddr_get_sgtable(adb->ddr, sgt, adb->offset,
+					 adb->size);
+	if (ret)
+		goto free_sgt;
+
+	sgt->nents = dma_map_sg(attach->dev, sgt->sgl, sgt->orig_nents, dir);
+	if (!sgt->nents) {
+		ret = -EINVAL;
+		goto free_table;
+	}
+
+	return sgt;
+
+free_table:
+	sg_free_table(sgt);
+free_sgt:
+	kfree(sgt);
+	return ERR_PTR(ret);
+}
+
+static void akida_dmabuf_unmap(struct dma_buf_attachment *attach,
+			       struct sg_table *sgt,
+			       enum dma_data_direction dir)
+{
+	dma_unmap_sg(attach->dev, sgt->sgl, sgt->orig_nents, dir);
+	sg_free_table(sgt);
+	kfree(sgt);
+}
+
+/* Protection of the user mappings, as dma_mmap_attrs() would set it */
+static pgprot_t akida_host_ddr_pgprot(struct akida_host_ddr *ddr,
+				      pgprot_t prot)
+{
+	if (ddr->cached || dev_is_dma_coherent(&ddr->pdev->dev))
+		return prot;
+
+	return pgprot_dmacoherent(prot);
+}
+
+/* Map the area from vm_pgoff in the whole vma, without changing its bounds:
+ * each contiguous part of the chunks is remapped at its place.
+ */
+static int akida_host_ddr_mmap(struct akida_host_ddr *ddr,
+			       struct vm_area_struct *vma)
+{
+	unsigned long addr = vma->vm_start;
+	struct scatterlist *sg;
+	struct sg_table sgt;
+	pgprot_t prot;
+	unsigned int i;
+	int ret;
+
+	ret = akida_host_ddr_get_sgtable(ddr, &sgt,
+					 (size_t)vma->vm_pgoff << PAGE_SHIFT,
+					 vma->vm_end - vma->vm_start);
+	if (ret)
+		return ret;
+
+	prot = akida_host_ddr_pgprot(ddr, vma->vm_page_prot);
+	for_each_sg(sgt.sgl, sg, sgt.orig_nents, i) {
+		ret = remap_pfn_range(vma, addr, page_to_pfn(sg_page(sg)),
+				      sg->length, prot);
+		if (ret)
+			break;
+		addr += sg->length;
+	}
+	sg_free_table(&sgt);
+	if (ret)
+		return ret;
+
+	vma->vm_page_prot = prot;
+	vma->vm_private_data = ddr;
+	vma->vm_ops = &akida_host_ddr_vm_ops;
+	akida_host_ddr_vm_open(vma);
+	return 0;
+}
+
+static int akida_dmabuf_mmap(struct dma_buf *dmabuf, struct vm_area_struct *vma)
+{
+	struct akida_dmabuf *adb = dmabuf->priv;
+
+	/* Private mappings would get copy-on-write anonymous pages over the
+	 * remapped ones.
+	 */
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	/* The dma-buf core checked the range against the slice size */
+	vma->vm_pgoff += adb->offset >> PAGE_SHIFT;
+	return akida_host_ddr_mmap(adb->ddr, vma);
+}
+
+/* DMA_BUF_IOCTL_SYNC of a slice of a cacheable host DDR area */
+static int akida_dmabuf_begin_cpu_access(struct dma_buf *dmabuf,
+					 enum dma_data_direction dir)
+{
+	struct akida_dmabuf *adb = dmabuf->priv;
+
+	if (adb->ddr->cached)
+		akida_host_ddr_sync(adb->ddr, adb->offset, adb->size, dir,
+				    false);
+	return 0;
+}
+
+static int akida_dmabuf_end_cpu_access(struct dma_buf *dmabuf,
+				       enum dma_data_direction dir)
+{
+	struct akida_dmabuf *adb = dmabuf->priv;
+
+	if (adb->ddr->cached)
+		akida_host_ddr_sync(adb->ddr, adb->offset, adb->size, dir,
+				    true);
+	return 0;
+}
+
+static void akida_dmabuf_release(struct dma_buf *dmabuf)
+{
+	struct akida_dmabuf *adb = dmabuf->priv;
+
+	akida_host_ddr_put(adb->ddr);
+	kfree(adb);
+}
+
+static const struct dma_buf_ops akida_dmabuf_ops = {
+	.map_dma_buf = akida_dmabuf_map,
+	.unmap_dma_buf = akida_dmabuf_unmap,
+	.mmap = akida_dmabuf_mmap,
+	.begin_cpu_access = akida_dmabuf_begin_cpu_access,
+	.end_cpu_access = akida_dmabuf_end_cpu_access,
+	.release = akida_dmabuf_release,
+};
+
+static long akida_ioctl_dmabuf_export(struct akida_dev *akida,
+				      struct akida_dmabuf_export __user *arg)
+{
+	DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
+	struct akida_dmabuf_export req;
+	struct akida_dmabuf *adb;
+	struct dma_buf *dmabuf;
+	int fd;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	if (!akida->host_ddr)
+		return -ENODEV;
+
+	if (req.flags & ~(O_CLOEXEC | O_ACCMODE) ||
+	    !PAGE_ALIGNED(req.offset) || !PAGE_ALIGNED(req.size) ||
+	    !req.size || req.offset >= akida->host_ddr->size ||
+	    req.size > akida->host_ddr->size - req.offset)
+		return -EINVAL;
+
+	adb = kzalloc(sizeof(*adb), GFP_KERNEL);
+	if (!adb)
+		return -ENOMEM;
+
+	adb->ddr = akida->host_ddr;
+	adb->offset = req.offset;
+	adb->size = req.size;
+
+	exp_info.ops = &akida_dmabuf_ops;
+	exp_info.size = req.size;
+	exp_info.flags = req.flags & O_ACCMODE;
+	exp_info.priv = adb;
+	dmabuf = dma_buf_export(&exp_info);
+	if (IS_ERR(dmabuf)) {
+		kfree(adb);
+		return PTR_ERR(dmabuf);
+	}
+	/* The dma-buf may outlive the device */
+	kref_get(&adb->ddr->ref);
+
+	fd = dma_buf_fd(dmabuf, req.flags & O_CLOEXEC);
+	if (fd < 0) {
+		/* Releases adb */
+		dma_buf_put(dmabuf);
+		return fd;
+	}
+
+	/* The fd can't be taken back once installed */
+	req.fd = fd;
+	if (copy_to_user(arg, &req, sizeof(req)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/* Wait for the fences of a dma-buf before accessing it */
+static long akida_dmabuf_wait(struct dma_buf *dmabuf, bool write)
+{
+	long ret;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 19, 0)
+	ret = dma_resv_wait_timeout(dmabuf->resv, dma_resv_usage_rw(write),
+				    true, msecs_to_jiffies(2000));
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 14, 0)
+	ret = dma_resv_wait_timeout(dmabuf->resv, write, true,
+				    msecs_to_jiffies(2000));
+#else
+	ret = dma_resv_wait_timeout_rcu(dmabuf->resv, write, true,
+					msecs_to_jiffies(2000));
+#endif
+	if (ret < 0)
+		return ret;
+
+	return ret ? 0 : -ETIMEDOUT;
+}
+
+static long akida_ioctl_dmabuf_xfer(struct akida_file *af,
+				    struct akida_dmabuf_xfer __user *arg)
+{
+	struct akida_dev *akida = af->akida;
+	struct dma_buf_attachment *attach;
+	struct akida_dma_chan *dma_chan;
+	struct akida_dmabuf_xfer req;
+	struct akida_chan_pool *pool;
+	enum dma_data_direction dir;
+	struct sg_table *dbuf_sgt;
+	struct dma_buf *dmabuf;
+	struct sg_table sgt;
+	struct device *dev;
+	long ret;
+	int n;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	switch (req.dir) {
+	case AKIDA_XFER_TO_DEV:
+		pool = &akida->chan_pool[1];
+		dir = DMA_TO_DEVICE;
+		break;
+	case AKIDA_XFER_FROM_DEV:
+		pool = &akida->chan_pool[0];
+		dir = DMA_FROM_DEVICE;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (!req.len || !akida_is_allowed(af, req.dev_addr, req.len))
+		return -EINVAL;
+
+	dmabuf = dma_buf_get(req.fd);
+	if (IS_ERR(dmabuf))
+		return PTR_ERR(dmabuf);
+
+	if (req.offset >= dmabuf->size ||
+	    req.len > dmabuf->size - req.offset) {
+		ret = -EINVAL;
+		goto put_dmabuf;
+	}
+
+	/* All the channels of a direction belong to the same DMA device */
+	dev = pool->chans[0].chan->device->dev;
+	attach = dma_buf_attach(dmabuf, dev);
+	if (IS_ERR(attach)) {
+		ret = PTR_ERR(attach);
+		goto put_dmabuf;
+	}
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 2, 0)
+	dbuf_sgt = dma_buf_map_attachment_unlocked(attach, dir);
+#else
+	dbuf_sgt = dma_buf_map_attachment(attach, dir);
+#endif
+	if (IS_ERR(dbuf_sgt)) {
+		ret = PTR_ERR(dbuf_sgt);
+		goto detach;
+	}
+
+	/* DMA segments of the dma-buf within the transfer */
+	n = akida_sg_dma_slice(&sgt, dbuf_sgt->sgl, dbuf_sgt->nents,
+			       req.offset, req.len);
+	if (n < 0) {
+		ret = n;
+		goto unmap;
+	}
+
+	ret = akida_dmabuf_wait(dmabuf, dir == DMA_FROM_DEVICE);
+	if (ret < 0)
+		goto free_sgt;
+
+	ret = akida_acquire_chans(pool, &dma_chan, 1, false, AKIDA_QOS_BULK);
+	if (ret < 0)
+		goto free_sgt;
+
+	ret = akida_dma_submit_sg(akida, dma_chan, req.dev_addr, sgt.sgl, n,
+				  &dma_chan->dma_complete);
+	if (!ret)
+		ret = akida_dma_wait_done(akida, dma_chan,
+					  &dma_chan->dma_complete);
+
+	akida_release_chans(&dma_chan, 1);
+
+free_sgt:
+	sg_free_table(&sgt);
+unmap:
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 2, 0)
+	dma_buf_unmap_attachment_unlocked(attach, dbuf_sgt, dir);
+#else
+	dma_buf_unmap_attachment(attach, dbuf_sgt, dir);
+#endif
+detach:
+	dma_buf_detach(dmabuf, attach);
+put_dmabuf:
+	dma_buf_put(dmabuf);
+	return ret;
+}
+
+static long akida_ioctl_buf_register(struct akida_file *af,
+				     struct akida_buf_register __user *arg)
+{
+	struct akida_buf __user *ubufs;
+	struct akida_buf_register req;
+	struct akida_regbuf **regs;
+	unsigned int i, index;
+	struct akida_buf buf;
+	long ret = 0;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	if (!req.nr_bufs || req.nr_bufs > AKIDA_BUF_MAX)
+		return -EINVAL;
+
+	regs = kcalloc(req.nr_bufs, sizeof(*regs), GFP_KERNEL);
+	if (!regs)
+		return -ENOMEM;
+
+	/* Pin and map all the buffers before registering any of them */
+	ubufs = u64_to_user_ptr(req.bufs);
+	for (i = 0; i < req.nr_bufs; i++) {
+		if (copy_from_user(&buf, &ubufs[i], sizeof(buf))) {
+			ret = -EFAULT;
+			goto put_regs;
+		}
+
+		regs[i] = akida_regbuf_create(af->akida, buf.addr, buf.len);
+		if (IS_ERR(regs[i])) {
+			ret = PTR_ERR(regs[i]);
+			regs[i] = NULL;
+			goto put_regs;
+		}
+	}
+
+	/* The buffers get consecutive indexes */
+	spin_lock(&af->bufs_lock);
+	for (index = 0; index + req.nr_bufs <= AKIDA_BUF_MAX; index++) {
+		for (i = 0; i < req.nr_bufs && !af->bufs[index + i]; i++)
+			;
+		if (i == req.nr_bufs)
+			break;
+	}
+	if (index + req.nr_bufs > AKIDA_BUF_MAX) {
+		spin_unlock(&af->bufs_lock);
+		ret = -ENOSPC;
+		goto put_regs;
+	}
+	for (i = 0; i < req.nr_bufs; i++)
+		af->bufs[index + i] = regs[i];
+	spin_unlock(&af->bufs_lock);
+
+	kfree(regs);
+
+	/* Registered buffers are released on close if the index is lost */
+	if (put_user(index, &arg->index))
+		return -EFAULT;
+	return 0;
+
+put_regs:
+	for (i = 0; i < req.nr_bufs; i++)
+		akida_regbuf_put(regs[i]);
+	kfree(regs);
+	return ret;
+}
+
+static long akida_ioctl_buf_unregister(struct akida_file *af,
+				       struct akida_buf_unregister __user *arg)
+{
+	struct akida_regbuf *regs[AKIDA_BUF_MAX];
+	struct akida_buf_unregister req;
+	unsigned int i;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	if (!req.nr_bufs || req.index >= AKIDA_BUF_MAX ||
+	    req.nr_bufs > AKIDA_BUF_MAX - req.index)
+		return -EINVAL;
+
+	spin_lock(&af->bufs_lock);
+	for (i = 0; i < req.nr_bufs; i++) {
+		if (!af->bufs[req.index + i]) {
+			spin_unlock(&af->bufs_lock);
+			return -EINVAL;
+		}
+	}
+	for (i = 0; i < req.nr_bufs; i++) {
+		regs[i] = af->bufs[req.index + i];
+		af->bufs[req.index + i] = NULL;
+	}
+	spin_unlock(&af->bufs_lock);
+
+	/* Transfers in flight hold their own reference */
+	for (i = 0; i < req.nr_bufs; i++)
+		akida_regbuf_put(regs[i]);
+
+	return 0;
+}
+
+static long akida_ioctl_chan_bind(struct akida_file *af,
+				  struct akida_chan_bind __user *arg)
+{
+	struct akida_chan_bind req;
+	unsigned int d;
+	long ret = 0;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	if (req.flags & ~(AKIDA_CHAN_BIND_RX | AKIDA_CHAN_BIND_TX))
+		return -EINVAL;
+
+	/* Index 0 is the rx (device to host) direction, 1 is the tx one */
+	for (d = 0; d < 2 && !ret; d++) {
+		bool bind = req.flags & (d ? AKIDA_CHAN_BIND_TX :
+					     AKIDA_CHAN_BIND_RX);
+
+		/* Wait for the transfers using the bound channel */
+		if (mutex_lock_interruptible(&af->bind_lock[d]))
+			return -ERESTARTSYS;
+		if (bind && !af->bound[d])
+			ret = akida_bind_chan(af, d);
+		else if (!bind && af->bound[d])
+			akida_unbind_chan(af, d);
+		mutex_unlock(&af->bind_lock[d]);
+	}
+
+	return ret;
+}
+
+static long akida_ioctl_set_qos(struct akida_file *af,
+				struct akida_set_qos __user *arg)
+{
+	struct akida_set_qos req;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	if (req.flags || (req.qos_class != AKIDA_QOS_BULK &&
+			  req.qos_class != AKIDA_QOS_LATENCY))
+		return -EINVAL;
+
+	WRITE_ONCE(af->qos_class, req.qos_class);
+	return 0;
+}
+
+static long akida_ioctl_host_ddr_sync(struct akida_dev *akida,
+				      struct akida_host_ddr_sync __user *arg)
+{
+	struct akida_host_ddr_sync req;
+	enum dma_data_direction dir;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	if (!akida->host_ddr)
+		return -ENODEV;
+
+	if (req.flags & ~(AKIDA_HOST_DDR_SYNC_RW | AKIDA_HOST_DDR_SYNC_END) ||
+	    !(req.flags & AKIDA_HOST_DDR_SYNC_RW) || req.reserved ||
+	    !req.size || req.offset >= akida->host_ddr->size ||
+	    req.size > akida->host_ddr->size - req.offset)
+		return -EINVAL;
+
+	/* Coherent area */
+	if (!akida->host_ddr->cached)
+		return 0;
+
+	switch (req.flags & AKIDA_HOST_DDR_SYNC_RW) {
+	case AKIDA_HOST_DDR_SYNC_READ:
+		dir = DMA_FROM_DEVICE;
+		break;
+	case AKIDA_HOST_DDR_SYNC_WRITE:
+		dir = DMA_TO_DEVICE;
+		break;
+	default:
+		dir = DMA_BIDIRECTIONAL;
+		break;
+	}
+
+	akida_host_ddr_sync(akida->host_ddr, req.offset, req.size, dir,
+			    req.flags & AKIDA_HOST_DDR_SYNC_END);
+	return 0;
+}
+
+/* Map [base, base + size) of the device address space to host memory at
+ * dma_addr, through an EP_iATU outbound region.
+ */
+static void akida_1500_setup_outbound(struct akida_dev *akida,
+				      unsigned int region, u32 base,
+				      size_t size, dma_addr_t dma_addr)
+{
+	void __iomem *regs = akida->mmio_bar0 + 0x400 + region * 0x200;
+
+	writel(0x00000000, regs + 0x04);
+	writel(0x00000000, regs + 0x00);
+	writel(base, regs + 0x08);
+	writel(0x00000000, regs + 0x0c);
+	writel(base + size - 1, regs + 0x10);
+	writel(lower_32_bits(dma_addr), regs + 0x14);
+	writel(upper_32_bits(dma_addr), regs + 0x18);
+	writel(0x80000000, regs + 0x04);
+}
+
+static void akida_1500_clear_outbound(struct akida_dev *akida,
+				      unsigned int region)
+{
+	void __iomem *regs = akida->mmio_bar0 + 0x400 + region * 0x200;
+
+	writel(0x00000000, regs + 0x04);
+	/* Flush the posted write: the region is disabled once read back */
+	readl(regs + 0x04);
+}
+
+/* Called with win_lock held */
+static void akida_outwin_destroy(struct akida_dev *akida,
+				 struct akida_outwin *win)
+{
+	unsigned int i;
+
+	/* Disable the regions before unmapping the pages */
+	for (i = 0; i < AKIDA_WIN_REGIONS_MAX; i++) {
+		if (akida->win[i] != win)
+			continue;
+		akida_1500_clear_outbound(akida,
+					  AKIDA_1500_WIN_REGION_FIRST + i);
+		akida->win[i] = NULL;
+	}
+	akida_regbuf_put(win->reg);
+	kfree(win);
+}
+
+static long akida_ioctl_win_map(struct akida_file *af,
+				struct akida_win_map __user *arg)
+{
+	struct akida_dev *akida = af->akida;
+	dma_addr_t seg_addr[AKIDA_WIN_REGIONS_MAX];
+	size_t seg_len[AKIDA_WIN_REGIONS_MAX];
+	unsigned int slot[AKIDA_WIN_REGIONS_MAX];
+	unsigned int nr_segs = 0, i, j;
+	struct akida_win_map req;
+	struct akida_outwin *win, *w;
+	struct scatterlist *sg;
+	u32 base;
+	long ret;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	/* Only the AKD1500 has spare outbound regions */
+	if (!akida->mmio_bar0)
+		return -ENODEV;
+
+	if (!req.len ||
+	    !IS_ALIGNED(req.addr | req.len | req.dev_addr, AKIDA_WIN_ALIGN) ||
+	    req.dev_addr < AKIDA_WIN_DEV_BASE ||
+	    req.dev_addr - AKIDA_WIN_DEV_BASE >= AKIDA_WIN_DEV_SIZE ||
+	    req.len > AKIDA_WIN_DEV_BASE + AKIDA_WIN_DEV_SIZE - req.dev_addr)
+		return -EINVAL;
+
+	win = kzalloc(sizeof(*win), GFP_KERNEL);
+	if (!win)
+		return -ENOMEM;
+
+	win->reg = akida_regbuf_create(akida, req.addr, req.len);
+	if (IS_ERR(win->reg)) {
+		ret = PTR_ERR(win->reg);
+		goto free_win;
+	}
+
+	/* Merge the DMA contiguous segments, one region each */
+	for_each_sg(win->reg->sgt.sgl, sg, win->reg->sgt.nents, i) {
+		if (nr_segs && seg_addr[nr_segs - 1] + seg_len[nr_segs - 1] ==
+			       sg_dma_address(sg)) {
+			seg_len[nr_segs - 1] += sg_dma_len(sg);
+			continue;
+		}
+		if (nr_segs == AKIDA_WIN_REGIONS_MAX) {
+			ret = -ENOSPC;
+			goto put_reg;
+		}
+		seg_addr[nr_segs] = sg_dma_address(sg);
+		seg_len[nr_segs++] = sg_dma_len(sg);
+	}
+
+	/* A region translates the address bits above its alignment only */
+	for (i = 0; i < nr_segs; i++) {
+		if (!IS_ALIGNED(seg_addr[i] | seg_len[i], AKIDA_WIN_ALIGN)) {
+			ret = -EINVAL;
+			goto put_reg;
+		}
+	}
+
+	mutex_lock(&akida->win_lock);
+	for (i = 0; i < AKIDA_WIN_REGIONS_MAX; i++) {
+		w = akida->win[i];
+		if (w && req.dev_addr < w->dev_addr + w->len &&
+		    w->dev_addr < req.dev_addr + req.len) {
+			ret = -EBUSY;
+			goto unlock;
+		}
+	}
+	for (i = 0, j = 0; i < AKIDA_WIN_REGIONS_MAX && j < nr_segs; i++)
+		if (!akida->win[i])
+			slot[j++] = i;
+	if (j < nr_segs) {
+		ret = -ENOSPC;
+		goto unlock;
+	}
+
+	win->af = af;
+	win->dev_addr = req.dev_addr;
+	win->len = req.len;
+	win->index = slot[0];
+	base = req.dev_addr;
+	for (j = 0; j < nr_segs; j++) {
+		akida->win[slot[j]] = win;
+		akida_1500_setup_outbound(akida,
+					  AKIDA_1500_WIN_REGION_FIRST + slot[j],
+					  base, seg_len[j], seg_addr[j]);
+		base += seg_len[j];
+	}
+
+	if (put_user(win->index, &arg->index)) {
+		akida_outwin_destroy(akida, win);
+		ret = -EFAULT;
+	} else
+		ret = 0;
+	mutex_unlock(&akida->win_lock);
+
+	return ret;
+
+unlock:
+	mutex_unlock(&akida->win_lock);
+put_reg:
+	akida_regbuf_put(win->reg);
+free_win:
+	kfree(win);
+	return ret;
+}
+
+static long akida_ioctl_win_unmap(struct akida_file *af,
+				  struct akida_win_unmap __user *arg)
+{
+	struct akida_dev *akida = af->akida;
+	struct akida_win_unmap req;
+	struct akida_outwin *win;
+	long ret = 0;
+
+	if (copy_from_user(&req, arg, sizeof(req)))
+		return -EFAULT;
+
+	if (req.flags || req.index >= AKIDA_WIN_REGIONS_MAX)
+		return -EINVAL;
+
+	mutex_lock(&akida->win_lock);
+	win = akida->win[req.index];
+	if (win && win->af == af && win->index == req.index)
+		akida_outwin_destroy(akida, win);
+	else
+		ret = -EINVAL;
+	mutex_unlock(&akida->win_lock);
+
+	return ret;
+}
+
+/* Remove the windows of a file, when closed or on the device removal */
+static void akida_outwin_release(struct akida_file *af)
+{
+	struct akida_dev *akida = af->akida;
+	unsigned int i;
+
+	mutex_lock(&akida->win_lock);
+	for (i = 0; i < AKIDA_WIN_REGIONS_MAX; i++)
+		if (akida->win[i] && akida->win[i]->af == af)
+			akida_outwin_destroy(akida, akida->win[i]);
+	mutex_unlock(&akida->win_lock);
+}
+
+static long akida_ioctl_cmd(struct file *file, unsigned int cmd,
+			    void __user *argp)
+{
+	struct akida_dev *akida = akida_file_dev(file);
+
+	switch (cmd) {
+	case AKIDA_IOCTL_XFER:
+		return akida_ioctl_xfer(file->private_data, argp);
+	case AKIDA_IOCTL_RING_SETUP:
+		return akida_ioctl_ring_setup(file->private_data, argp);
+	case AKIDA_IOCTL_DMABUF_EXPORT:
+		return akida_ioctl_dmabuf_export(akida, argp);
+	case AKIDA_IOCTL_DMABUF_XFER:
+		return akida_ioctl_dmabuf_xfer(file->private_data, argp);
+	case AKIDA_IOCTL_BUF_REGISTER:
+		return akida_ioctl_buf_register(file->private_data, argp);
+	case AKIDA_IOCTL_BUF_UNREGISTER:
+		return akida_ioctl_buf_unregister(file->private_data, argp);
+	case AKIDA_IOCTL_CHAN_BIND:
+		return akida_ioctl_chan_bind(file->private_data, argp);
+	case AKIDA_IOCTL_SET_QOS:
+		return akida_ioctl_set_qos(file->private_data, argp);
+	case AKIDA_IOCTL_HOST_DDR_SYNC:
+		return akida_ioctl_host_ddr_sync(akida, argp);
+	case AKIDA_IOCTL_WIN_MAP:
+		return akida_ioctl_win_map(file->private_data, argp);
+	case AKIDA_IOCTL_WIN_UNMAP:
+		return akida_ioctl_win_unmap(file->private_data, argp);
+	default:
+		return -ENOTTY;
+	}
+}
+
+static long akida_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+	struct akida_dev *akida = akida_file_dev(file);
+	long ret;
+
+	/* Takes the remove lock itself, not while waiting */
+	if (cmd == AKIDA_IOCTL_RING_ENTER)
+		return akida_ioctl_ring_enter(file->private_data,
+					      (void __user *)arg);
+
+	ret = akida_op_begin(akida);
+	if (ret)
+		return ret;
+	ret = akida_ioctl_cmd(file, cmd, (void __user *)arg);
+	akida_op_end(akida);
+
+	return ret;
+}
+
+static int akida_open(struct inode *inode, struct file *file)
+{
+	struct akida_file *af;
+
+	af = kzalloc(sizeof(*af), GFP_KERNEL);
+	if (!af)
+		return -ENOMEM;
+
+	/* file->private_data is set to the misc device on open, the misc
+	 * device lock keeps it registered meanwhile.
+	 */
+	af->akida = container_of(file->private_data, struct akida_dev, miscdev);
+	kref_get(&af->akida->ref);
+	mutex_init(&af->lock);
+	spin_lock_init(&af->bufs_lock);
+	mutex_init(&af->bind_lock[0]);
+	mutex_init(&af->bind_lock[1]);
+	file->private_data = af;
+
+	mutex_lock(&af->akida->files_lock);
+	list_add_tail(&af->node, &af->akida->files);
+	mutex_unlock(&af->akida->files_lock);
+
+	/* Asynchronous transfers honor IOCB_NOWAIT */
+	file->f_mode |= FMODE_NOWAIT;
+#ifdef FMODE_CAN_ODIRECT
+	/* io_uring IOPOLL requires O_DIRECT */
+	file->f_mode |= FMODE_CAN_ODIRECT;
+#endif
+	return 0;
+}
+
+/* Release what a file holds of the device, on close or on the removal of the
+ * device, files_lock being held.
+ */
+static void akida_file_detach(struct akida_file *af)
+{
+	struct akida_regbuf *reg;
+	unsigned int i;
+
+	if (af->ring) {
+		akida_ring_stop(af->ring);
+		wake_up_all(&af->ring->cq_wait);
+	}
+	for (i = 0; i < 2; i++)
+		if (af->bound[i])
+			akida_unbind_chan(af, i);
+	akida_outwin_release(af);
+
+	/* The registered buffers are DMA unmapped while the device is
+	 * there, the windows holding references being gone already.
+	 */
+	for (i = 0; i < AKIDA_BUF_MAX; i++) {
+		spin_lock(&af->bufs_lock);
+		reg = af->bufs[i];
+		af->bufs[i] = NULL;
+		spin_unlock(&af->bufs_lock);
+		akida_regbuf_put(reg);
+	}
+}
+
+static int akida_release(struct inode *inode, struct file *file)
+{
+	struct akida_file *af = file->private_data;
+	struct akida_dev *akida = af->akida;
+
+	mutex_lock(&akida->files_lock);
+	list_del(&af->node);
+	akida_file_detach(af);
+	if (af->ring)
+		akida_ring_destroy(af->ring);
+	mutex_unlock(&akida->files_lock);
+
+	kfree(af);
+	akida_dev_put(akida);
+	return 0;
+}
+
+static const struct vm_operations_struct akida_vm_ops = {
+#ifdef CONFIG_HAVE_IOREMAP_PROT
+	.access = generic_access_phys,
+#endif
+};
+
+/* Range of BAR4 pages holding the DMA RAM area of the DMA controller, which
+ * the CPU only maps for the linked-lists.
+ */
+static void akida_bar4_dma_ram_pages(struct akida_dev *akida,
+				     resource_size_t *start,
+				     resource_size_t *end)
+{
+	*start = ALIGN_DOWN(akida->dma_ram.offset, PAGE_SIZE);
+	*end = PAGE_ALIGN(akida->dma_ram.offset + akida->dma_ram.size);
+}
+
+/* Range of BAR4 pages after the DMA RAM area only mapped write-combining */
+static void akida_bar4_wc_pages(struct akida_dev *akida,
+				resource_size_t *start, resource_size_t *end)
+{
+	resource_size_t ram_start;
+
+	akida_bar4_dma_ram_pages(akida, &ram_start, start);
+	*end = min(*start + akida->bar4_wc_size,
+		   pci_resource_len(akida->pdev, BAR_4));
+}
+
+/* A page never gets mappings of different types: x86 PAT would downgrade
+ * the write-combining ones to uncached, and arm64 does not allow it. BAR4
+ * mappings are then write-combining only in the part reserved for it and
+ * never include the DMA RAM area pages.
+ */
+static bool akida_bar4_mmap_allowed(struct akida_dev *akida,
+				    struct vm_area_struct *vma, bool wc)
+{
+	resource_size_t start = (resource_size_t)vma->vm_pgoff << PAGE_SHIFT;
+	resource_size_t end = start + (vma->vm_end - vma->vm_start);
+	resource_size_t ram_start, ram_end, wc_start, wc_end;
+
+	akida_bar4_dma_ram_pages(akida, &ram_start, &ram_end);
+	akida_bar4_wc_pages(akida, &wc_start, &wc_end);
+	if (wc)
+		return start >= wc_start && end <= wc_end;
+
+	return end <= ram_start || start >= wc_end;
+}
+
+static int akida_mmap(struct akida_dev *akida, unsigned int bar,
+		      struct vm_area_struct *vma, bool wc)
+{
+	vma->vm_pgoff += (pci_resource_start(akida->pdev, bar) >> PAGE_SHIFT);
+	vma->vm_page_prot = wc ? pgprot_writecombine(vma->vm_page_prot) :
+				 pgprot_noncached(vma->vm_page_prot);
+	vma->vm_ops = &akida_vm_ops;
+
+	return io_remap_pfn_range(vma, vma->vm_start, vma->vm_pgoff,
+				  vma->vm_end - vma->vm_start,
+				  vma->vm_page_prot);
+
+}
+
+static int akida_1000_mmap_dev(struct file *file, struct vm_area_struct *vma)
+{
+	struct akida_dev *akida = akida_file_dev(file);
+	unsigned long size;
+
+	if (vma->vm_pgoff == AKIDA_RING_MMAP_OFFSET >> PAGE_SHIFT)
+		return akida_ring_mmap(file, vma);
+
+	if (!(pci_resource_flags(akida->pdev, BAR_0) & IORESOURCE_MEM))
+		return -EINVAL;
+
+	size = ((pci_resource_len(akida->pdev, BAR_0) - 1) >> PAGE_SHIFT) + 1;
+	if (vma->vm_pgoff + vma_pages(vma) > size)
+		return -EINVAL;
+
+	return akida_mmap(akida, BAR_0, vma, false);
+}
+
+static int akida_1500_mmap_dev(struct file *file, struct vm_area_struct *vma)
+{
+	struct akida_dev *akida = akida_file_dev(file);
+	unsigned long start [3], size[3];
+	unsigned int bar;
+	bool wc = false;
+
+	if (vma->vm_pgoff == AKIDA_RING_MMAP_OFFSET >> PAGE_SHIFT)
+		return akida_ring_mmap(file, vma);
+
+	/* Private mappings would get copy-on-write anonymous pages over the
+	 * remapped ones.
+	 */
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	if (vma->vm_pgoff >= AKIDA_MMAP_WC_OFFSET >> PAGE_SHIFT) {
+		vma->vm_pgoff -= AKIDA_MMAP_WC_OFFSET >> PAGE_SHIFT;
+		wc = true;
+	}
 
 	start[0] = AKIDA_1500_BAR2_OFFSET >> PAGE_SHIFT;
 	start[1] = AKIDA_1500_BAR4_OFFSET >> PAGE_SHIFT;
 	start[2] = AKIDA_1500_HOST_DDR_BASE >> PAGE_SHIFT;
 	size[0] = ((pci_resource_len(akida->pdev, BAR_2) - 1) >> PAGE_SHIFT) + 1;
 	size[1] = ((pci_resource_len(akida->pdev, BAR_4) - 1) >> PAGE_SHIFT) + 1;
-	size[2] = ((akida->host_ddr.size - 1) >> PAGE_SHIFT) + 1;
+	size[2] = akida->host_ddr ?
+		  ((akida->host_ddr->size - 1) >> PAGE_SHIFT) + 1 : 0;
+
+	/* Only the DMA RAM, registers stay uncached */
+	if (wc && !(start[1] <= vma->vm_pgoff &&
+		    (vma->vm_pgoff + vma_pages(vma)) <= (start[1] + size[1])))
+		return -EINVAL;
 
 	if (start[0] <= vma->vm_pgoff &&
 	    (vma->vm_pgoff + vma_pages(vma)) <= (start[0] + size[0])) {
@@ -466,33 +4030,76 @@ static int akida_1500_mmap(struct file *file, struct vm_area_struct *vma)
 		   (vma->vm_pgoff + vma_pages(vma)) <= (start[1] + size[1])) {
 		bar = BAR_4;
 		vma->vm_pgoff -= start[1];
-	} else if (akida->host_ddr.size && start[2] <= vma->vm_pgoff &&
+		if (!akida_bar4_mmap_allowed(akida, vma, wc))
+			return -EINVAL;
+	} else if (akida->host_ddr && start[2] <= vma->vm_pgoff &&
 		   (vma->vm_pgoff + vma_pages(vma)) <= (start[2] + size[2])) {
 		vma->vm_pgoff -= start[2];
-		return dma_mmap_attrs(&akida->pdev->dev, vma,
-			akida->host_ddr.cpu_addr, akida->host_ddr.dma_addr,
-			AKIDA_1500_HOST_DDR_BASE, AKIDA_1500_HOST_DDR_DMA_ATTRS);
+		return akida_host_ddr_mmap(akida->host_ddr, vma);
 	} else
 		return -EINVAL;
 
-	if (!(pci_resource_flags(akida->pdev, bar) & IORESOURCE_MEM))
-		return -EINVAL;
+	if (!(pci_resource_flags(akida->pdev, bar) & IORESOURCE_MEM))
+		return -EINVAL;
+
+	return akida_mmap(akida, bar, vma, wc);
+}
+
+/* mmap() runs with the mmap lock held, that the file operations may take
+ * with the remove lock held: it does not wait for the removal, which is in
+ * progress when the lock is not free.
+ */
+static int akida_mmap_op(struct file *file, struct vm_area_struct *vma,
+			 int (*mmap)(struct file *, struct vm_area_struct *))
+{
+	struct akida_dev *akida = akida_file_dev(file);
+	int ret = -ENODEV;
+
+	if (!down_read_trylock(&akida->remove_lock))
+		return ret;
+	if (!akida->removed)
+		ret = mmap(file, vma);
+	up_read(&akida->remove_lock);
+
+	return ret;
+}
+
+static int akida_1000_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	return akida_mmap_op(file, vma, akida_1000_mmap_dev);
+}
 
-	return akida_mmap(akida, bar, vma);
+static int akida_1500_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	return akida_mmap_op(file, vma, akida_1500_mmap_dev);
 }
 
 static const struct file_operations akida_1000_fops = {
 	.owner = THIS_MODULE,
-	.write = akida_write,
-	.read = akida_read,
+	.open = akida_open,
+	.release = akida_release,
+	.write_iter = akida_write_iter,
+	.read_iter = akida_read_iter,
+	.iopoll = akida_iopoll,
+	.unlocked_ioctl = akida_ioctl,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0)
+	.compat_ioctl = compat_ptr_ioctl,
+#endif
 	.llseek = no_seek_end_llseek,
 	.mmap = akida_1000_mmap,
 };
 
 static const struct file_operations akida_1500_fops = {
 	.owner = THIS_MODULE,
-	.write = akida_write,
-	.read = akida_read,
+	.open = akida_open,
+	.release = akida_release,
+	.write_iter = akida_write_iter,
+	.read_iter = akida_read_iter,
+	.iopoll = akida_iopoll,
+	.unlocked_ioctl = akida_ioctl,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 5, 0)
+	.compat_ioctl = compat_ptr_ioctl,
+#endif
 	.llseek = no_seek_end_llseek,
 	.mmap = akida_1500_mmap,
 };
@@ -511,7 +4118,7 @@ static const struct akida_iatu_conf akida_1000_iatu_conf_table[] = {
 	 */
 	{.addr = 0x0900, .val = 0x80000000},
 	{.addr = 0x0904, .val = 0x00000000},
-	{.addr = 0x0918, .val = 0xFCC00000},
+	{.addr = 0x0918, .val = AKIDA_1000_BAR0_OFFSET},
 	{.addr = 0x0908, .val = 0xC0080000},
 
 	/* EP_iATU Region 1 Inbound Setting
@@ -540,30 +4147,130 @@ static const struct akida_iatu_conf akida_1000_iatu_conf_table[] = {
 	{0}
 };
 
+/* Allocate a chunk: coherent memory, or cacheable pages with
+ * host_ddr_cached, synchronized by AKIDA_IOCTL_HOST_DDR_SYNC.
+ */
+static void *akida_1500_alloc_host_ddr(struct akida_host_ddr *ddr,
+				       struct akida_host_ddr_chunk *c)
+{
+	struct device *dev = &ddr->pdev->dev;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 10, 0)
+	if (ddr->cached) {
+		c->page = dma_alloc_pages(dev, c->size, &c->dma_addr,
+					  DMA_BIDIRECTIONAL,
+					  GFP_KERNEL | __GFP_NOWARN);
+		return c->page ? page_address(c->page) : NULL;
+	}
+#endif
+
+	return dma_alloc_attrs(dev, c->size, &c->dma_addr, GFP_KERNEL,
+			       AKIDA_1500_HOST_DDR_DMA_ATTRS);
+}
+
+static void akida_1500_put_host_ddr(void *data)
+{
+	akida_host_ddr_put(data);
+}
+
+/* Allocate host_ddr_size bytes in chunks of at most 16 MiB, halving the
+ * chunk size when an allocation fails, down to 1 MiB. The area may end up
+ * smaller than requested, it is disabled if no chunk can be allocated.
+ * The device reference on the area is dropped on unbind.
+ */
 static int akida_1500_setup_host_ddr(struct akida_dev *akida)
 {
-	akida->host_ddr.size = AKIDA_1500_HOST_DDR_SIZE_MAX;
-	while (akida->host_ddr.size >= AKIDA_1500_HOST_DDR_SIZE_MIN) {
-		akida->host_ddr.cpu_addr = dmam_alloc_attrs(&akida->pdev->dev,
-			akida->host_ddr.size, &akida->host_ddr.dma_addr,
-			GFP_KERNEL, AKIDA_1500_HOST_DDR_DMA_ATTRS);
+	size_t chunk_size = AKIDA_1500_HOST_DDR_CHUNK_MAX;
+	struct akida_host_ddr_chunk *c;
+	struct akida_host_ddr *ddr;
+
+	if (!host_ddr_size || host_ddr_size > AKIDA_1500_HOST_DDR_SIZE_MAX ||
+	    !IS_ALIGNED(host_ddr_size, AKIDA_1500_HOST_DDR_CHUNK_MIN)) {
+		pci_err(akida->pdev, "invalid host ddr area size (%u bytes)\n",
+			host_ddr_size);
+		return -EINVAL;
+	}
 
-		if (akida->host_ddr.cpu_addr) {
-			pci_info(akida->pdev, "Host ddr area: %zu bytes\n",
-				akida->host_ddr.size);
-			return 0;
+	ddr = kzalloc(sizeof(*ddr), GFP_KERNEL);
+	if (!ddr)
+		return -ENOMEM;
+	kref_init(&ddr->ref);
+	ddr->pdev = pci_dev_get(akida->pdev);
+
+	ddr->cached = host_ddr_cached;
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 10, 0)
+	if (ddr->cached) {
+		pci_warn(akida->pdev, "Cached host ddr area needs kernel 5.10 or later\n");
+		ddr->cached = false;
+	}
+#endif
+
+	while (ddr->size < host_ddr_size &&
+	       ddr->nr_chunks < AKIDA_1500_HOST_DDR_CHUNKS_MAX &&
+	       chunk_size >= AKIDA_1500_HOST_DDR_CHUNK_MIN) {
+		c = &ddr->chunk[ddr->nr_chunks];
+		c->offset = ddr->size;
+		c->size = min_t(size_t, chunk_size, host_ddr_size - ddr->size);
+		c->cpu_addr = akida_1500_alloc_host_ddr(ddr, c);
+		if (!c->cpu_addr) {
+			chunk_size = ALIGN_DOWN(c->size / 2,
+						AKIDA_1500_HOST_DDR_CHUNK_MIN);
+			pci_info(akida->pdev, "Host ddr area: Allocate %zu failed -> Try %zu\n",
+				 c->size, chunk_size);
+			continue;
 		}
-		pci_info(akida->pdev, "Host ddr area: Allocate %zu failed -> Try %zu\n",
-				akida->host_ddr.size,
-				akida->host_ddr.size / 2);
-		akida->host_ddr.size /= 2;
+
+		ddr->size += c->size;
+		ddr->nr_chunks++;
+	}
+
+	if (!ddr->size) {
+		pci_err(akida->pdev, "Failed to allocate host ddr area (%u bytes)\n",
+			host_ddr_size);
+		akida_host_ddr_put(ddr);
+		/* Disable the host ddr access feature */
+		return 0;
+	}
+
+	if (devm_add_action_or_reset(&akida->pdev->dev,
+				     akida_1500_put_host_ddr, ddr))
+		return -ENOMEM;
+	akida->host_ddr = ddr;
+
+	pci_info(akida->pdev, "Host ddr area: %zu bytes in %u chunks%s\n",
+		 ddr->size, ddr->nr_chunks, ddr->cached ? ", cached" : "");
+	if (ddr->size < host_ddr_size)
+		pci_warn(akida->pdev, "Host ddr area smaller than requested (%u bytes)\n",
+			 host_ddr_size);
+	return 0;
+}
+
+static int akida_1500_setup_ll_host(struct akida_dev *akida)
+{
+	unsigned int nr_chans = clamp_t(unsigned int, dma_chans, 1,
+					AKIDA_DMA_CHAN_MAX);
+	size_t size = 2 * nr_chans * (size_t)ll_host_size;
+
+	if (ll_host_size < AKIDA_DMA_LL_CHAN_MIN ||
+	    !IS_ALIGNED(ll_host_size, 8) ||
+	    size > AKIDA_1500_LL_HOST_SIZE_MAX) {
+		pci_err(akida->pdev, "invalid linked-list size in host memory (%u bytes per channel)\n",
+			ll_host_size);
+		return -EINVAL;
+	}
+
+	akida->ll_host.cpu_addr = dmam_alloc_coherent(&akida->pdev->dev, size,
+						      &akida->ll_host.dma_addr,
+						      GFP_KERNEL);
+	if (!akida->ll_host.cpu_addr) {
+		pci_err(akida->pdev, "Failed to allocate linked-lists in host memory (%zu bytes)\n",
+			size);
+		return -ENOMEM;
 	}
+	akida->ll_host.size = size;
 
-	pci_err(akida->pdev, "Failed to allocate host ddr area (%zu bytes)\n",
-		akida->host_ddr.size);
+	pci_info(akida->pdev, "Linked-lists in host memory: %zu bytes\n", size);
 
-	/* Disable the host ddr access feature */
-	akida->host_ddr.size = 0;
 	return 0;
 }
 
@@ -615,6 +4322,7 @@ static int akida_1500_setup_iatu(struct akida_dev *akida)
 {
 	const struct akida_iatu_conf *conf = akida_1500_iatu_conf_table;
 	struct pci_dev *pdev = akida->pdev;
+	unsigned int i;
 	int ret;
 
 	/* Mapping PCI BAR regions:
@@ -632,18 +4340,25 @@ static int akida_1500_setup_iatu(struct akida_dev *akida)
 		conf++;
 	}
 
-	if (akida->host_ddr.size) {
+	for (i = 0; akida->host_ddr && i < akida->host_ddr->nr_chunks; i++) {
 		/* Host DDR
-		 * EP_iATU Region 0 Outbound Setting
+		 * EP_iATU Region 0 Outbound Setting for the first chunk,
+		 * Regions 2 and up for the next ones
+		 */
+		akida_1500_setup_outbound(akida, i ? i + 1 : 0,
+					  AKIDA_1500_HOST_DDR_BASE +
+					  akida->host_ddr->chunk[i].offset,
+					  akida->host_ddr->chunk[i].size,
+					  akida->host_ddr->chunk[i].dma_addr);
+	}
+
+	if (akida->ll_host.size) {
+		/* DMA linked-lists
+		 * EP_iATU Region 1 Outbound Setting
 		 */
-		writel(0x00000000, akida->mmio_bar0 + 0x404);
-		writel(0x00000000, akida->mmio_bar0 + 0x400);
-		writel(AKIDA_1500_HOST_DDR_BASE, akida->mmio_bar0 + 0x408);
-		writel(0x00000000, akida->mmio_bar0 + 0x40c);
-		writel(AKIDA_1500_HOST_DDR_BASE + akida->host_ddr.size - 1, akida->mmio_bar0 + 0x410);
-		writel(lower_32_bits(akida->host_ddr.dma_addr), akida->mmio_bar0 + 0x414);
-		writel(upper_32_bits(akida->host_ddr.dma_addr), akida->mmio_bar0 + 0x418);
-		writel(0x80000000, akida->mmio_bar0 + 0x404);
+		akida_1500_setup_outbound(akida, 1, AKIDA_1500_LL_HOST_BASE,
+					  akida->ll_host.size,
+					  akida->ll_host.dma_addr);
 	}
 
 	/* Provide 1000ms sleep for iATU's to be setup */
@@ -652,13 +4367,33 @@ static int akida_1500_setup_iatu(struct akida_dev *akida)
 	return 0;
 }
 
+/* BAR4 is only reserved here: it is mapped in parts once the DMA RAM layout
+ * is known, see akida_dma_ram_ll_map() and akida_setup_pio_bar4().
+ */
+static int akida_request_bar4(struct pci_dev *pdev)
+{
+	if (!devm_request_mem_region(&pdev->dev,
+				     pci_resource_start(pdev, BAR_4),
+				     pci_resource_len(pdev, BAR_4),
+				     pci_name(pdev)))
+		return -EBUSY;
+
+	return 0;
+}
+
 static int akida_1000_setup_iomap(struct pci_dev *pdev)
 {
+	int ret;
+
 	/* PCI BAR regions:
 	 *  - BAR2: eDMA regs,
 	 *  - BAR4: eDMA linked-list and data
 	 */
-	return pcim_iomap_regions(pdev, BIT(BAR_2) | BIT(BAR_4), pci_name(pdev));
+	ret = pcim_iomap_regions(pdev, BIT(BAR_2), pci_name(pdev));
+	if (ret)
+		return ret;
+
+	return akida_request_bar4(pdev);
 }
 
 static int akida_1500_setup_iomap(struct pci_dev *pdev)
@@ -666,7 +4401,7 @@ static int akida_1500_setup_iomap(struct pci_dev *pdev)
 	/* PCI BAR regions:
 	 *  - BAR4: eDMA linked-list and data
 	 */
-	return pcim_iomap_regions(pdev, BIT(BAR_4), pci_name(pdev));
+	return akida_request_bar4(pdev);
 }
 
 
@@ -708,11 +4443,273 @@ static bool akida_dma_chan_filter(struct dma_chan *chan, void *param)
 	return true;
 }
 
+static void akida_dma_free_bounce(struct akida_dma_chan *dma_chan)
+{
+	struct device *chan_dev = dma_chan->chan->device->dev;
+	struct akida_dma_block *b;
+	struct akida_dma_buf *buf;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(dma_chan->bounce); i++) {
+		buf = &dma_chan->bounce[i];
+		while (buf->nr_blocks) {
+			b = &buf->block[--buf->nr_blocks];
+			dma_unmap_page(chan_dev, b->dma_addr, b->size,
+				       dma_chan->dma_data_dir);
+			__free_pages(b->page, get_order(b->size));
+		}
+		buf->size = 0;
+	}
+}
+
+/* Allocate and map a block of at most 2^order pages, halving it when the
+ * allocation fails. Return its order, or a negative error code.
+ */
+static int akida_dma_alloc_block(struct device *chan_dev,
+				 enum dma_data_direction dir,
+				 struct akida_dma_block *b, int order)
+{
+	for (; order >= 0; order--) {
+		b->page = alloc_pages(GFP_KERNEL | __GFP_NOWARN, order);
+		if (b->page)
+			break;
+	}
+	if (!b->page)
+		return -ENOMEM;
+
+	/* Mapped once, the block is then only synced around each transfer.
+	 * Its ownership is given back to the CPU between transfers.
+	 */
+	b->size = PAGE_SIZE << order;
+	b->dma_addr = dma_map_page(chan_dev, b->page, 0, b->size, dir);
+	if (dma_mapping_error(chan_dev, b->dma_addr)) {
+		__free_pages(b->page, order);
+		return -ENOMEM;
+	}
+	dma_sync_single_for_cpu(chan_dev, b->dma_addr, b->size, dir);
+
+	return order;
+}
+
+static int akida_dma_alloc_bounce(struct akida_dev *akida,
+				  struct akida_dma_chan *dma_chan)
+{
+	struct device *chan_dev = dma_chan->chan->device->dev;
+	struct akida_dma_buf *buf;
+	unsigned int i;
+	int order;
+
+	for (i = 0; i < ARRAY_SIZE(dma_chan->bounce); i++) {
+		buf = &dma_chan->bounce[i];
+		init_completion(&buf->done.done);
+
+		/* A block never exceeds the remaining size: the blocks
+		 * allocated before are at least as large.
+		 */
+		order = get_order(AKIDA_DMA_BOUNCE_SIZE);
+		while (buf->size < AKIDA_DMA_BOUNCE_SIZE &&
+		       buf->nr_blocks < AKIDA_DMA_BOUNCE_BLOCKS_MAX) {
+			order = akida_dma_alloc_block(chan_dev,
+						      dma_chan->dma_data_dir,
+						      &buf->block[buf->nr_blocks],
+						      order);
+			if (order < 0)
+				break;
+			buf->size += buf->block[buf->nr_blocks++].size;
+		}
+		if (!buf->size) {
+			pci_err(akida->pdev, "Failed to allocate bounce buffer\n");
+			goto err;
+		}
+		if (buf->size < AKIDA_DMA_BOUNCE_SIZE)
+			pci_warn(akida->pdev, "Bounce buffer reduced to %zu bytes\n",
+				 buf->size);
+	}
+
+	return 0;
+
+err:
+	akida_dma_free_bounce(dma_chan);
+	return -ENOMEM;
+}
+
+static void akida_dma_region(struct dw_edma_region *region,
+			     void __iomem *base, phys_addr_t offset, size_t sz)
+{
+	region->vaddr.io = base ? base + offset : NULL;
+	region->paddr = AKIDA_DMA_RAM_PHY_ADDR + offset;
+	region->sz = sz;
+}
+
+/* Split the linked-lists in host memory between the write and read channels.
+ * They are written with CPU stores instead of PCIe writes, and read by the
+ * DMA controller through an outbound window.
+ */
+static void akida_setup_ll_host(struct akida_dev *akida, unsigned int nr_chans)
+{
+	struct dw_edma_chip *chip = &akida->edma_chip;
+	size_t sz = akida->ll_host.size / (2 * nr_chans);
+	size_t off = 0;
+	unsigned int i;
+
+	for (i = 0; i < 2 * nr_chans; i++, off += sz) {
+		struct dw_edma_region *region = i < nr_chans ?
+			&chip->ll_region_wr[i] : &chip->ll_region_rd[i - nr_chans];
+
+		region->vaddr.mem = akida->ll_host.cpu_addr + off;
+		region->paddr = AKIDA_1500_LL_HOST_BASE + off;
+		region->sz = sz;
+	}
+
+	chip->flags |= DW_EDMA_CHIP_LL_MEM;
+}
+
+/* Choose the DMA RAM layout and the number of DMA channels per direction.
+ * Without any dma_ram_* module parameter, the linked-list and data areas
+ * of the build configuration are split between the channels. Otherwise
+ * the linked-lists of all the channels are followed by their data.
+ */
+static int akida_dma_ram_layout(struct akida_dev *akida,
+				unsigned int *nr_chans)
+{
+	struct akida_dma_ram *ram = &akida->dma_ram;
+	struct pci_dev *pdev = akida->pdev;
+	unsigned int nr = clamp_t(unsigned int, dma_chans, 1,
+				  AKIDA_DMA_CHAN_MAX);
+	bool build_cfg = dma_ram_offset < 0 && dma_ram_ll_size < 0 &&
+			 dma_ram_dt_size < 0;
+	unsigned int nr_max;
+
+	if (build_cfg && !akida->ll_host.size) {
+		nr_max = max_t(unsigned int, 1, AKIDA_DMA_RAM_PHY_LL_SIZE /
+			       (2 * AKIDA_DMA_LL_CHAN_MIN));
+		if (nr > nr_max) {
+			pci_warn(pdev, "DMA RAM linked-list area too small for %u channels, using %u\n",
+				 nr, nr_max);
+			nr = nr_max;
+		}
+	}
+
+	ram->ll_size = dma_ram_ll_size < 0 ?
+		       ALIGN_DOWN(AKIDA_DMA_RAM_PHY_LL_SIZE / (2 * nr), 8) :
+		       dma_ram_ll_size;
+	ram->dt_size = dma_ram_dt_size < 0 ?
+		       ALIGN_DOWN(AKIDA_DMA_RAM_PHY_DT_SIZE / (2 * nr), 8) :
+		       dma_ram_dt_size;
+
+	if (build_cfg) {
+		ram->offset = AKIDA_DMA_RAM_PHY_OFFSET;
+		ram->size = AKIDA_DMA_RAM_PHY_SIZE;
+		ram->ll_offset = AKIDA_DMA_RAM_PHY_LL_OFFSET;
+		ram->dt_offset = AKIDA_DMA_RAM_PHY_DT_OFFSET;
+	} else {
+		ram->offset = dma_ram_offset < 0 ?
+			      AKIDA_DMA_RAM_PHY_OFFSET : dma_ram_offset;
+		ram->size = 2 * nr * (ram->ll_size + ram->dt_size);
+		ram->ll_offset = ram->offset;
+		ram->dt_offset = ram->offset + 2 * nr * ram->ll_size;
+	}
+
+	if (!IS_ALIGNED(ram->offset, 8) || !IS_ALIGNED(ram->ll_size, 8) ||
+	    !IS_ALIGNED(ram->dt_size, 8) ||
+	    (ram->ll_size < AKIDA_DMA_LL_CHAN_MIN && !akida->ll_host.size)) {
+		pci_err(pdev, "invalid DMA RAM layout: offset 0x%llx, linked-list 0x%zx, data 0x%zx bytes per channel\n",
+			(u64)ram->offset, ram->ll_size, ram->dt_size);
+		return -EINVAL;
+	}
+
+	if (ram->offset + ram->size > pci_resource_len(pdev, BAR_4)) {
+		pci_err(pdev, "DMA RAM area 0x%llx-0x%llx beyond BAR4 (0x%llx bytes)\n",
+			(u64)ram->offset, (u64)(ram->offset + ram->size),
+			(u64)pci_resource_len(pdev, BAR_4));
+		return -EINVAL;
+	}
+
+	*nr_chans = nr;
+	return 0;
+}
+
+/* Map the linked-lists of the DMA RAM, written by the eDMA driver. Return
+ * the BAR4 base to use for the linked-list regions.
+ */
+static void __iomem *akida_dma_ram_ll_map(struct akida_dev *akida,
+					  unsigned int nr_chans)
+{
+	struct akida_dma_ram *ram = &akida->dma_ram;
+	struct pci_dev *pdev = akida->pdev;
+	void __iomem *ll;
+
+	ll = devm_ioremap(&pdev->dev,
+			  pci_resource_start(pdev, BAR_4) + ram->ll_offset,
+			  2 * nr_chans * ram->ll_size);
+	if (!ll)
+		return NULL;
+
+	return ll - ram->ll_offset;
+}
+
+/* Split the DMA RAM between the write and read channels. BAR4 maps to
+ * AKIDA_DMA_RAM_PHY_ADDR from the DMA controller point of view.
+ */
+static int akida_setup_dma_ram(struct akida_dev *akida)
+{
+	struct akida_dma_ram *ram = &akida->dma_ram;
+	struct dw_edma_chip *chip = &akida->edma_chip;
+	void __iomem *ll_base = NULL;
+	phys_addr_t ll_off, dt_off;
+	unsigned int nr_chans;
+	unsigned int i;
+	int ret;
+
+	ret = akida_dma_ram_layout(akida, &nr_chans);
+	if (ret)
+		return ret;
+
+	chip->ll_wr_cnt = nr_chans;
+	chip->ll_rd_cnt = nr_chans;
+
+	if (akida->ll_host.size) {
+		akida_setup_ll_host(akida, nr_chans);
+	} else {
+		ll_base = akida_dma_ram_ll_map(akida, nr_chans);
+		if (!ll_base) {
+			pci_err(akida->pdev, "DMA linked-lists I/O remapping failed\n");
+			return -ENOMEM;
+		}
+	}
+
+	/* Write (tx) channels first, then read (rx) channels */
+	ll_off = ram->ll_offset;
+	dt_off = ram->dt_offset;
+	for (i = 0; i < nr_chans; i++) {
+		if (!akida->ll_host.size)
+			akida_dma_region(&chip->ll_region_wr[i], ll_base,
+					 ll_off, ram->ll_size);
+		/* Data regions are only accessed by the DMA controller */
+		akida_dma_region(&chip->dt_region_wr[i], NULL, dt_off,
+				 ram->dt_size);
+		ll_off += ram->ll_size;
+		dt_off += ram->dt_size;
+	}
+	for (i = 0; i < nr_chans; i++) {
+		if (!akida->ll_host.size)
+			akida_dma_region(&chip->ll_region_rd[i], ll_base,
+					 ll_off, ram->ll_size);
+		akida_dma_region(&chip->dt_region_rd[i], NULL, dt_off,
+				 ram->dt_size);
+		ll_off += ram->ll_size;
+		dt_off += ram->dt_size;
+	}
+
+	return 0;
+}
+
 static int akida_dma_init(struct akida_dev *akida)
 {
 	struct akida_filter_param p;
 	dma_cap_mask_t mask;
 	unsigned int i;
+	int ret;
 
 	dma_cap_zero(mask);
 	dma_cap_set(DMA_SLAVE, mask);
@@ -721,73 +4718,119 @@ static int akida_dma_init(struct akida_dev *akida)
 	p.dir_mask = BIT(DMA_DEV_TO_MEM) | BIT(DMA_MEM_TO_DEV);
 
 	/* 1. Init rx channels */
-	for (i = 0; i < ARRAY_SIZE(akida->rxchan); i++) {
+	for (i = 0; i < akida->nr_chans; i++) {
 		p.dir_exp = BIT(DMA_DEV_TO_MEM);
 		akida->rxchan[i].chan = dma_request_channel(mask,
 						akida_dma_chan_filter, &p);
 		if (!akida->rxchan[i].chan) {
 			pci_err(akida->pdev, "Request DMA rxchan[%u] fails\n",
 				i);
+			ret = -EBUSY;
 			goto free_rxchan;
 		}
 		module_put(akida->edma_chip.dev->driver->owner);
 
-		init_completion(&akida->rxchan[i].dma_complete);
+		init_completion(&akida->rxchan[i].dma_complete.done);
 
 		akida->rxchan[i].dma_xfer_dir = DMA_DEV_TO_MEM;
 		akida->rxchan[i].dma_data_dir = DMA_FROM_DEVICE;
+
+		ret = akida_dma_alloc_bounce(akida, &akida->rxchan[i]);
+		if (ret)
+			goto free_rxchan;
 	}
 
 
 	/* 2. Init tx channels */
-	for (i = 0; i < ARRAY_SIZE(akida->txchan); i++) {
+	for (i = 0; i < akida->nr_chans; i++) {
 		p.dir_exp = BIT(DMA_MEM_TO_DEV);
 		akida->txchan[i].chan = dma_request_channel(mask,
 						akida_dma_chan_filter, &p);
 		if (!akida->txchan[i].chan)  {
 			pci_err(akida->pdev, "Request DMA txchan[%u] fails\n",
 				i);
+			ret = -EBUSY;
 			goto free_txchan;
 		}
 		module_put(akida->edma_chip.dev->driver->owner);
 
-		init_completion(&akida->txchan[i].dma_complete);
+		init_completion(&akida->txchan[i].dma_complete.done);
 
 		akida->txchan[i].dma_xfer_dir = DMA_MEM_TO_DEV;
 		akida->txchan[i].dma_data_dir = DMA_TO_DEVICE;
+
+		ret = akida_dma_alloc_bounce(akida, &akida->txchan[i]);
+		if (ret)
+			goto free_txchan;
 	}
 
 	return 0;
 
 free_txchan:
-	for (i = 0; i < ARRAY_SIZE(akida->txchan); i++) {
+	for (i = 0; i < akida->nr_chans; i++) {
 		if (akida->txchan[i].chan) {
+			akida_dma_free_bounce(&akida->txchan[i]);
 			__module_get(akida->edma_chip.dev->driver->owner);
 			dma_release_channel(akida->txchan[i].chan);
 		}
 	}
 free_rxchan:
-	for (i = 0; i < ARRAY_SIZE(akida->rxchan); i++) {
+	for (i = 0; i < akida->nr_chans; i++) {
 		if (akida->rxchan[i].chan) {
+			akida_dma_free_bounce(&akida->rxchan[i]);
 			__module_get(akida->edma_chip.dev->driver->owner);
 			dma_release_channel(akida->rxchan[i].chan);
 		}
 	}
-	return -EBUSY;
+	return ret;
+}
+
+static bool akida_aio_idle(struct akida_dev *akida)
+{
+	bool idle;
+
+	spin_lock(&akida->aio_lock);
+	idle = list_empty(&akida->aio_list);
+	spin_unlock(&akida->aio_lock);
+
+	return idle;
+}
+
+/* Wait for the asynchronous transfers in flight before the channels go away,
+ * new ones being refused as the device is marked removed. Transfers still
+ * running after the DMA timeout are stopped, their kiocbs completing with an
+ * error.
+ */
+static void akida_aio_drain(struct akida_dev *akida)
+{
+	unsigned int i;
+
+	if (wait_event_timeout(akida->aio_wq, akida_aio_idle(akida),
+			       msecs_to_jiffies(2000)))
+		return;
+
+	pci_warn(akida->pdev, "Stopping asynchronous transfers in flight\n");
+	for (i = 0; i < akida->nr_chans; i++) {
+		dmaengine_terminate_async(akida->txchan[i].chan);
+		dmaengine_terminate_async(akida->rxchan[i].chan);
+	}
+	wait_event(akida->aio_wq, akida_aio_idle(akida));
 }
 
 static void akida_dma_exit(struct akida_dev *akida)
 {
 	unsigned int i;
 
-	for (i = 0; i < ARRAY_SIZE(akida->txchan); i++) {
+	for (i = 0; i < akida->nr_chans; i++) {
 		dmaengine_terminate_sync(akida->txchan[i].chan);
+		akida_dma_free_bounce(&akida->txchan[i]);
 		__module_get(akida->edma_chip.dev->driver->owner);
 		dma_release_channel(akida->txchan[i].chan);
 	}
 
-	for (i = 0; i < ARRAY_SIZE(akida->rxchan); i++) {
+	for (i = 0; i < akida->nr_chans; i++) {
 		dmaengine_terminate_sync(akida->rxchan[i].chan);
+		akida_dma_free_bounce(&akida->rxchan[i]);
 		__module_get(akida->edma_chip.dev->driver->owner);
 		dma_release_channel(akida->rxchan[i].chan);
 	}
@@ -802,12 +4845,179 @@ static const struct dw_edma_plat_ops akida_dw_edma_plat_ops = {
 	.irq_vector = akida_dw_edma_pcie_irq_vector,
 };
 
+static struct akida_dev *akida_misc_dev(struct device *dev)
+{
+	struct miscdevice *miscdev = dev_get_drvdata(dev);
+
+	return container_of(miscdev, struct akida_dev, miscdev);
+}
+
+static ssize_t pio_max_show(struct device *dev, struct device_attribute *attr,
+			    char *buf)
+{
+	struct akida_dev *akida = akida_misc_dev(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(akida->pio_max));
+}
+
+static ssize_t pio_max_store(struct device *dev, struct device_attribute *attr,
+			     const char *buf, size_t count)
+{
+	struct akida_dev *akida = akida_misc_dev(dev);
+	unsigned int val;
+	int ret;
+
+	ret = kstrtouint(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	if (val > AKIDA_PIO_SIZE_MAX)
+		return -EINVAL;
+
+	WRITE_ONCE(akida->pio_max, val);
+	return count;
+}
+static DEVICE_ATTR_RW(pio_max);
+
+/* Transfers of a class waiting for or running on a channel, rx then tx */
+static ssize_t akida_qos_depth_show(struct akida_dev *akida, unsigned int cls,
+				    char *buf)
+{
+	unsigned int depth[2];
+	unsigned int d;
+
+	for (d = 0; d < 2; d++)
+		depth[d] = atomic_read(&akida->chan_pool[d].waiting[cls]) +
+			   atomic_read(&akida->chan_pool[d].active[cls]);
+
+	return sprintf(buf, "%u %u\n", depth[0], depth[1]);
+}
+
+static ssize_t latency_depth_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	return akida_qos_depth_show(akida_misc_dev(dev), AKIDA_QOS_LATENCY,
+				    buf);
+}
+static DEVICE_ATTR_RO(latency_depth);
+
+static ssize_t bulk_depth_show(struct device *dev,
+			       struct device_attribute *attr, char *buf)
+{
+	return akida_qos_depth_show(akida_misc_dev(dev), AKIDA_QOS_BULK, buf);
+}
+static DEVICE_ATTR_RO(bulk_depth);
+
+static struct attribute *akida_attrs[] = {
+	&dev_attr_pio_max.attr,
+	&dev_attr_latency_depth.attr,
+	&dev_attr_bulk_depth.attr,
+	NULL
+};
+ATTRIBUTE_GROUPS(akida);
+
+/* BAR mapping a device address range, usable for programmed I/O */
+struct akida_pio_bar {
+	int bar;
+	phys_addr_t dev_addr;
+};
+
+static const struct akida_pio_bar akida_1000_pio_bars[] = {
+	{.bar = BAR_0, .dev_addr = AKIDA_1000_BAR0_OFFSET},
+	{.bar = BAR_4, .dev_addr = AKIDA_DMA_RAM_PHY_ADDR},
+};
+
+static const struct akida_pio_bar akida_1500_pio_bars[] = {
+	{.bar = BAR_2, .dev_addr = AKIDA_1500_BAR2_OFFSET},
+	{.bar = BAR_4, .dev_addr = AKIDA_1500_BAR4_OFFSET},
+};
+
+/* Programmed I/O windows of BAR4: the parts before and after the DMA RAM
+ * area pages and the write-combining part, mapped uncached.
+ */
+static void akida_setup_pio_bar4(struct akida_dev *akida,
+				 phys_addr_t dev_addr)
+{
+	struct pci_dev *pdev = akida->pdev;
+	resource_size_t len = pci_resource_len(pdev, BAR_4);
+	resource_size_t start[2], end[2], wc_start;
+	struct akida_pio_win *win;
+	void __iomem *base;
+	unsigned int i;
+
+	start[0] = 0;
+	akida_bar4_dma_ram_pages(akida, &end[0], &wc_start);
+	akida_bar4_wc_pages(akida, &wc_start, &start[1]);
+	end[1] = len;
+
+	for (i = 0; i < 2 && akida->nr_pio_win < AKIDA_PIO_WIN_NR; i++) {
+		if (start[i] >= min(end[i], len))
+			continue;
+
+		base = devm_ioremap(&pdev->dev,
+				    pci_resource_start(pdev, BAR_4) + start[i],
+				    min(end[i], len) - start[i]);
+		if (!base) {
+			pci_warn(pdev, "BAR4 I/O remapping failed, no programmed I/O\n");
+			continue;
+		}
+
+		win = &akida->pio_win[akida->nr_pio_win++];
+		win->dev_addr = dev_addr + start[i];
+		win->base = base;
+		win->size = min(end[i], len) - start[i];
+	}
+}
+
+static void akida_setup_pio(struct akida_dev *akida,
+			    const struct akida_pio_bar *pio_bars,
+			    unsigned int nr_pio_bars)
+{
+	struct pci_dev *pdev = akida->pdev;
+	struct akida_pio_win *win;
+	void __iomem * const *table;
+	unsigned int i;
+	int ret;
+
+	akida->pio_max = AKIDA_PIO_SIZE_DEFAULT;
+
+	for (i = 0; i < nr_pio_bars && akida->nr_pio_win < AKIDA_PIO_WIN_NR;
+	     i++) {
+		if (pio_bars[i].bar == BAR_4) {
+			akida_setup_pio_bar4(akida, pio_bars[i].dev_addr);
+			continue;
+		}
+
+		/* BARs not mapped yet are only needed for programmed I/O, a
+		 * failure just disables it on the window.
+		 */
+		table = pcim_iomap_table(pdev);
+		if (table && !table[pio_bars[i].bar]) {
+			ret = pcim_iomap_regions(pdev, BIT(pio_bars[i].bar),
+						 pci_name(pdev));
+			if (ret)
+				pci_warn(pdev, "BAR%d I/O remapping failed (%d), no programmed I/O\n",
+					 pio_bars[i].bar, ret);
+		}
+		if (!table || !table[pio_bars[i].bar])
+			continue;
+
+		win = &akida->pio_win[akida->nr_pio_win++];
+		win->dev_addr = pio_bars[i].dev_addr;
+		win->base = table[pio_bars[i].bar];
+		win->size = pci_resource_len(pdev, pio_bars[i].bar);
+	}
+}
+
 struct akida_ops {
 	char miscdev_name[10];
 	int (*setup_host_ddr)(struct akida_dev *akida);
+	int (*setup_ll_host)(struct akida_dev *akida);
 	int (*setup_iatu)(struct akida_dev *akida);
 	int (*setup_iomap)(struct pci_dev *pdev);
 	void (*setup_dma_reg_base)(struct akida_dev *akida);
+	const struct akida_pio_bar *pio_bars;
+	unsigned int nr_pio_bars;
 	const struct file_operations *fops;
 	enum dw_edma_map_format mf;
 };
@@ -817,6 +5027,8 @@ static struct akida_ops akida_1000_ops = {
 	.setup_iatu = akida_1000_setup_iatu,
 	.setup_iomap = akida_1000_setup_iomap,
 	.setup_dma_reg_base = akida_1000_setup_dma_reg_base,
+	.pio_bars = akida_1000_pio_bars,
+	.nr_pio_bars = ARRAY_SIZE(akida_1000_pio_bars),
 	.fops = &akida_1000_fops,
 	.mf = EDMA_MF_EDMA_LEGACY,
 };
@@ -824,25 +5036,47 @@ static struct akida_ops akida_1000_ops = {
 static struct akida_ops akida_1500_ops = {
 	.miscdev_name = "akd1500_",
 	.setup_host_ddr = akida_1500_setup_host_ddr,
+	.setup_ll_host = akida_1500_setup_ll_host,
 	.setup_iatu = akida_1500_setup_iatu,
 	.setup_iomap = akida_1500_setup_iomap,
 	.setup_dma_reg_base = akida_1500_setup_dma_reg_base,
+	.pio_bars = akida_1500_pio_bars,
+	.nr_pio_bars = ARRAY_SIZE(akida_1500_pio_bars),
 	.fops = &akida_1500_fops,
 	.mf = EDMA_MF_HDMA_NATIVE,
 };
 
+static void akida_put_dev(void *data)
+{
+	akida_dev_put(data);
+}
+
 static int akida_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 {
 	int board_id = id->driver_data;
 	struct akida_dev *akida;
 	struct akida_ops ops;
 	int ret, nr_irqs;
+	unsigned int i;
 
-	akida = devm_kzalloc(&pdev->dev, sizeof(*akida), GFP_KERNEL);
+	akida = kzalloc(sizeof(*akida), GFP_KERNEL);
 	if (!akida)
 		return -ENOMEM;
 
-	akida->pdev = pdev;
+	kref_init(&akida->ref);
+	akida->pdev = pci_dev_get(pdev);
+	/* The device reference is dropped on unbind, the files keep theirs */
+	ret = devm_add_action_or_reset(&pdev->dev, akida_put_dev, akida);
+	if (ret)
+		return ret;
+
+	spin_lock_init(&akida->aio_lock);
+	INIT_LIST_HEAD(&akida->aio_list);
+	init_waitqueue_head(&akida->aio_wq);
+	init_rwsem(&akida->remove_lock);
+	mutex_init(&akida->files_lock);
+	INIT_LIST_HEAD(&akida->files);
+	mutex_init(&akida->win_lock);
 
 	switch (board_id) {
 	case AKIDA_1000:
@@ -852,6 +5086,7 @@ static int akida_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	case AKIDA_1500:
 		ops = akida_1500_ops;
 		akida->ida = &akida_1500_devno;
+		akida->bar4_wc_size = PAGE_ALIGN(dma_ram_wc_size);
 		break;
 	default:
 		return -EOPNOTSUPP;
@@ -918,6 +5153,19 @@ static int akida_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 		}
 	}
 
+	/* Setup DMA linked-lists in host memory */
+	if (ll_host_size) {
+		if (ops.setup_ll_host) {
+			ret = ops.setup_ll_host(akida);
+			if (ret) {
+				pci_err(pdev, "seting up linked-lists in host memory failed (%d)\n", ret);
+				return ret;
+			}
+		} else {
+			pci_warn(pdev, "linked-lists in host memory not supported\n");
+		}
+	}
+
 	/* Setup iATU */
 	ret = ops.setup_iatu(akida);
 	if (ret) {
@@ -950,60 +5198,15 @@ static int akida_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	/* Setup eDMA engine */
 	ops.setup_dma_reg_base(akida);
 
-	/* 2 write and 2 read channels */
-	akida->edma_chip.ll_wr_cnt = 2;
-	akida->edma_chip.ll_rd_cnt = 2;
-
-	/* BAR4 maps to 0x2000000 from DMA controller point of view
-	 * This area contains linked-list and data buffers (1MB + 3MB)
+	/* Write (tx) and read (rx) channels, with their linked-list and data
+	 * regions in the DMA RAM.
 	 */
-	akida->edma_chip.ll_region_wr[0].vaddr.io = pcim_iomap_table(pdev)[BAR_4];
-	akida->edma_chip.ll_region_wr[0].vaddr.io += AKIDA_DMA_RAM_PHY_LL_OFFSET(TX,0);
-	akida->edma_chip.ll_region_wr[0].paddr = AKIDA_DMA_RAM_PHY_ADDR;
-	akida->edma_chip.ll_region_wr[0].paddr += AKIDA_DMA_RAM_PHY_LL_OFFSET(TX,0);
-	akida->edma_chip.ll_region_wr[0].sz = AKIDA_DMA_RAM_PHY_LL_SIZE(TX,0);
-
-	akida->edma_chip.dt_region_wr[0].vaddr.io = pcim_iomap_table(pdev)[BAR_4];
-	akida->edma_chip.dt_region_wr[0].vaddr.io += AKIDA_DMA_RAM_PHY_DT_OFFSET(TX,0);
-	akida->edma_chip.dt_region_wr[0].paddr = AKIDA_DMA_RAM_PHY_ADDR;
-	akida->edma_chip.dt_region_wr[0].paddr += AKIDA_DMA_RAM_PHY_DT_OFFSET(TX,0);
-	akida->edma_chip.dt_region_wr[0].sz = AKIDA_DMA_RAM_PHY_DT_SIZE(TX,0);
-
-	akida->edma_chip.ll_region_wr[1].vaddr.io = pcim_iomap_table(pdev)[BAR_4];
-	akida->edma_chip.ll_region_wr[1].vaddr.io += AKIDA_DMA_RAM_PHY_LL_OFFSET(TX,1);
-	akida->edma_chip.ll_region_wr[1].paddr = AKIDA_DMA_RAM_PHY_ADDR;
-	akida->edma_chip.ll_region_wr[1].paddr += AKIDA_DMA_RAM_PHY_LL_OFFSET(TX,1);
-	akida->edma_chip.ll_region_wr[1].sz = AKIDA_DMA_RAM_PHY_LL_SIZE(TX,1);
-
-	akida->edma_chip.dt_region_wr[1].vaddr.io = pcim_iomap_table(pdev)[BAR_4];
-	akida->edma_chip.dt_region_wr[1].vaddr.io += AKIDA_DMA_RAM_PHY_DT_OFFSET(TX,1);
-	akida->edma_chip.dt_region_wr[1].paddr = AKIDA_DMA_RAM_PHY_ADDR;
-	akida->edma_chip.dt_region_wr[1].paddr += AKIDA_DMA_RAM_PHY_DT_OFFSET(TX,1);
-	akida->edma_chip.dt_region_wr[1].sz = AKIDA_DMA_RAM_PHY_DT_SIZE(TX,1);
-
-	akida->edma_chip.ll_region_rd[0].vaddr.io = pcim_iomap_table(pdev)[BAR_4];
-	akida->edma_chip.ll_region_rd[0].vaddr.io += AKIDA_DMA_RAM_PHY_LL_OFFSET(RX,0);
-	akida->edma_chip.ll_region_rd[0].paddr = AKIDA_DMA_RAM_PHY_ADDR;
-	akida->edma_chip.ll_region_rd[0].paddr += AKIDA_DMA_RAM_PHY_LL_OFFSET(RX,0);
-	akida->edma_chip.ll_region_rd[0].sz = AKIDA_DMA_RAM_PHY_LL_SIZE(RX,0);
-
-	akida->edma_chip.dt_region_rd[0].vaddr.io = pcim_iomap_table(pdev)[BAR_4];
-	akida->edma_chip.dt_region_rd[0].vaddr.io += AKIDA_DMA_RAM_PHY_DT_OFFSET(RX,0);
-	akida->edma_chip.dt_region_rd[0].paddr = AKIDA_DMA_RAM_PHY_ADDR;
-	akida->edma_chip.dt_region_rd[0].paddr += AKIDA_DMA_RAM_PHY_DT_OFFSET(RX,0);
-	akida->edma_chip.dt_region_rd[0].sz = AKIDA_DMA_RAM_PHY_DT_SIZE(RX,0);
-
-	akida->edma_chip.ll_region_rd[1].vaddr.io = pcim_iomap_table(pdev)[BAR_4];
-	akida->edma_chip.ll_region_rd[1].vaddr.io += AKIDA_DMA_RAM_PHY_LL_OFFSET(RX,1);
-	akida->edma_chip.ll_region_rd[1].paddr = AKIDA_DMA_RAM_PHY_ADDR;
-	akida->edma_chip.ll_region_rd[1].paddr += AKIDA_DMA_RAM_PHY_LL_OFFSET(RX,1);
-	akida->edma_chip.ll_region_rd[1].sz = AKIDA_DMA_RAM_PHY_LL_SIZE(RX,1);
-
-	akida->edma_chip.dt_region_rd[1].vaddr.io = pcim_iomap_table(pdev)[BAR_4];
-	akida->edma_chip.dt_region_rd[1].vaddr.io += AKIDA_DMA_RAM_PHY_DT_OFFSET(RX,1);
-	akida->edma_chip.dt_region_rd[1].paddr = AKIDA_DMA_RAM_PHY_ADDR;
-	akida->edma_chip.dt_region_rd[1].paddr += AKIDA_DMA_RAM_PHY_DT_OFFSET(RX,1);
-	akida->edma_chip.dt_region_rd[1].sz = AKIDA_DMA_RAM_PHY_DT_SIZE(RX,1);
+	ret = akida_setup_dma_ram(akida);
+	if (ret)
+		goto fail_free_irq_vectors;
+
+	/* Programmed I/O windows, around the DMA RAM area */
+	akida_setup_pio(akida, ops.pio_bars, ops.nr_pio_bars);
 
 	akida->edma_chip.mf = ops.mf;
 	akida->edma_chip.nr_irqs = 1;
@@ -1029,30 +5232,26 @@ static int akida_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	}
 	pci_dbg(pdev, "Registers: addr(v=%p)\n",
 		akida->edma_chip.reg_base);
-	pci_dbg(pdev, "Wr[0] LL:   addr(v=%p, p=%pa), sz=0x%zx bytes\n",
-		akida->edma_chip.ll_region_wr[0].vaddr.io, &akida->edma_chip.ll_region_wr[0].paddr,
-		akida->edma_chip.ll_region_wr[0].sz);
-	pci_dbg(pdev, "Wr[0] Data: addr(v=%p, p=%pa), sz=0x%zx bytes\n",
-		akida->edma_chip.dt_region_wr[0].vaddr.io, &akida->edma_chip.dt_region_wr[0].paddr,
-		akida->edma_chip.dt_region_wr[0].sz);
-	pci_dbg(pdev, "Wr[1] LL:   addr(v=%p, p=%pa), sz=0x%zx bytes\n",
-		akida->edma_chip.ll_region_wr[1].vaddr.io, &akida->edma_chip.ll_region_wr[1].paddr,
-		akida->edma_chip.ll_region_wr[1].sz);
-	pci_dbg(pdev, "Wr[1] Data: addr(v=%p, p=%pa), sz=0x%zx bytes\n",
-		akida->edma_chip.dt_region_wr[1].vaddr.io, &akida->edma_chip.dt_region_wr[1].paddr,
-		akida->edma_chip.dt_region_wr[1].sz);
-	pci_dbg(pdev, "Rd[0] LL:   addr(v=%p, p=%pa), sz=0x%zx bytes\n",
-		akida->edma_chip.ll_region_rd[0].vaddr.io, &akida->edma_chip.ll_region_rd[0].paddr,
-		akida->edma_chip.ll_region_rd[0].sz);
-	pci_dbg(pdev, "Rd[0] Data: addr(v=%p, p=%pa), sz=0x%zx bytes\n",
-		akida->edma_chip.dt_region_rd[0].vaddr.io, &akida->edma_chip.dt_region_rd[0].paddr,
-		akida->edma_chip.dt_region_rd[0].sz);
-	pci_dbg(pdev, "Rd[1] LL:   addr(v=%p, p=%pa), sz=0x%zx bytes\n",
-		akida->edma_chip.ll_region_rd[1].vaddr.io, &akida->edma_chip.ll_region_rd[1].paddr,
-		akida->edma_chip.ll_region_rd[1].sz);
-	pci_dbg(pdev, "Rd[1] Data: addr(v=%p, p=%pa), sz=0x%zx bytes\n",
-		akida->edma_chip.dt_region_rd[1].vaddr.io, &akida->edma_chip.dt_region_rd[1].paddr,
-		akida->edma_chip.dt_region_rd[1].sz);
+	for (i = 0; i < akida->edma_chip.ll_wr_cnt; i++) {
+		pci_dbg(pdev, "Wr[%u] LL:   addr(v=%p, p=%pa), sz=0x%zx bytes\n",
+			i, akida->edma_chip.ll_region_wr[i].vaddr.io,
+			&akida->edma_chip.ll_region_wr[i].paddr,
+			akida->edma_chip.ll_region_wr[i].sz);
+		pci_dbg(pdev, "Wr[%u] Data: addr(v=%p, p=%pa), sz=0x%zx bytes\n",
+			i, akida->edma_chip.dt_region_wr[i].vaddr.io,
+			&akida->edma_chip.dt_region_wr[i].paddr,
+			akida->edma_chip.dt_region_wr[i].sz);
+	}
+	for (i = 0; i < akida->edma_chip.ll_rd_cnt; i++) {
+		pci_dbg(pdev, "Rd[%u] LL:   addr(v=%p, p=%pa), sz=0x%zx bytes\n",
+			i, akida->edma_chip.ll_region_rd[i].vaddr.io,
+			&akida->edma_chip.ll_region_rd[i].paddr,
+			akida->edma_chip.ll_region_rd[i].sz);
+		pci_dbg(pdev, "Rd[%u] Data: addr(v=%p, p=%pa), sz=0x%zx bytes\n",
+			i, akida->edma_chip.dt_region_rd[i].vaddr.io,
+			&akida->edma_chip.dt_region_rd[i].paddr,
+			akida->edma_chip.dt_region_rd[i].sz);
+	}
 	pci_dbg(pdev, "Nr. IRQs: %u\n", akida->edma_chip.nr_irqs);
 
 	akida->edma_chip.dev = &pdev->dev;
@@ -1064,6 +5263,25 @@ static int akida_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 		goto fail_free_irq_vectors;
 	}
 
+	/* The controller may have less channels than requested */
+	akida->nr_chans = min(akida->edma_chip.dw->wr_ch_cnt,
+			      akida->edma_chip.dw->rd_ch_cnt);
+	if (!akida->nr_chans) {
+		pci_err(pdev, "no DMA channel\n");
+		ret = -ENODEV;
+		goto fail_dw_edma_remove;
+	}
+	pci_dbg(pdev, "DMA channels: %u per direction\n", akida->nr_chans);
+
+	akida->rxchan = devm_kcalloc(&pdev->dev, akida->nr_chans,
+				     sizeof(*akida->rxchan), GFP_KERNEL);
+	akida->txchan = devm_kcalloc(&pdev->dev, akida->nr_chans,
+				     sizeof(*akida->txchan), GFP_KERNEL);
+	if (!akida->rxchan || !akida->txchan) {
+		ret = -ENOMEM;
+		goto fail_dw_edma_remove;
+	}
+
 	/* Init dma */
 	ret = akida_dma_init(akida);
 	if (ret) {
@@ -1072,8 +5290,10 @@ static int akida_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 	}
 
 	/* Init waitqueues */
-	init_waitqueue_head(&akida->wq_rxchan);
-	init_waitqueue_head(&akida->wq_txchan);
+	akida_chan_pool_init(&akida->chan_pool[0], akida->rxchan,
+			     akida->nr_chans);
+	akida_chan_pool_init(&akida->chan_pool[1], akida->txchan,
+			     akida->nr_chans);
 
 #if LINUX_VERSION_CODE <= KERNEL_VERSION(4, 19, 0)
 	ret = ida_simple_get(akida->ida, 0, 0, GFP_KERNEL);
@@ -1097,6 +5317,7 @@ static int akida_probe(struct pci_dev *pdev, const struct pci_device_id *id)
 					     akida->devno);
 	akida->miscdev.fops = ops.fops;
 	akida->miscdev.parent = &pdev->dev;
+	akida->miscdev.groups = akida_groups;
 
 	pci_set_drvdata(pdev, akida);
 
@@ -1128,6 +5349,9 @@ fail_free_irq_vectors:
 static void akida_remove(struct pci_dev *pdev)
 {
 	struct akida_dev *akida = pci_get_drvdata(pdev);
+	bool chans = akida->txchan && akida->txchan[0].chan &&
+		     akida->rxchan && akida->rxchan[0].chan;
+	struct akida_file *af;
 	int ret;
 
 	misc_deregister(&akida->miscdev);
@@ -1136,7 +5360,22 @@ static void akida_remove(struct pci_dev *pdev)
 #else
 	ida_free(akida->ida, akida->devno);
 #endif
-	if (akida->txchan[0].chan && akida->rxchan[0].chan)
+
+	/* Wait for the file operations in progress, the next ones fail */
+	down_write(&akida->remove_lock);
+	akida->removed = true;
+	up_write(&akida->remove_lock);
+
+	if (chans)
+		akida_aio_drain(akida);
+
+	/* The files still open keep nothing of the device */
+	mutex_lock(&akida->files_lock);
+	list_for_each_entry(af, &akida->files, node)
+		akida_file_detach(af);
+	mutex_unlock(&akida->files_lock);
+
+	if (chans)
 		akida_dma_exit(akida);
 	if (akida->edma_chip.dev) {
 		ret = akida_dw_edma_remove(&akida->edma_chip);
@@ -1183,3 +5422,8 @@ module_pci_driver(akida_driver);
 
 MODULE_DESCRIPTION("Brainchip Akida PCIe");
 MODULE_LICENSE("GPL");
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+MODULE_IMPORT_NS("DMA_BUF");
+#elif LINUX_VERSION_CODE >= KERNEL_VERSION(5, 16, 0)
+MODULE_IMPORT_NS(DMA_BUF);
+#endif
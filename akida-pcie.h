@@ -0,0 +1,438 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Copyright (c) 2022 Brainchip.
+ * Akida PCIe driver user API
+ */
+#ifndef _AKIDA_PCIE_H
+#define _AKIDA_PCIE_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define AKIDA_IOCTL_MAGIC 0xBC
+
+/* Direction of a transfer */
+#define AKIDA_XFER_TO_DEV	1	/* Host to device (write) */
+#define AKIDA_XFER_FROM_DEV	2	/* Device to host (read) */
+
+/* Maximum number of transfers in a transfer list */
+#define AKIDA_XFER_MAX		1024
+
+/* struct akida_xfer_list flags */
+#define AKIDA_XFER_LIST_LATENCY	(1U << 0)	/* Latency class, see AKIDA_IOCTL_SET_QOS */
+
+/* struct akida_xfer and struct akida_sqe flags */
+#define AKIDA_XFER_FIXED_BUF	(1U << 0)	/* Registered buffer, see AKIDA_IOCTL_BUF_REGISTER */
+
+/**
+ * struct akida_xfer - One transfer of a transfer list
+ * @dev_addr: Device address, as the offset used with pread()/pwrite()
+ * @user_addr: User buffer address, or with AKIDA_XFER_FIXED_BUF the offset
+ *             in the registered buffer buf_index
+ * @len: Transfer length in bytes
+ * @dir: AKIDA_XFER_TO_DEV or AKIDA_XFER_FROM_DEV
+ * @status: Set by the driver, 0 on success or a negative error code
+ * @flags: AKIDA_XFER_FIXED_BUF
+ * @buf_index: Registered buffer index with AKIDA_XFER_FIXED_BUF, else 0
+ */
+struct akida_xfer {
+	__u64 dev_addr;
+	__u64 user_addr;
+	__u64 len;
+	__u32 dir;
+	__s32 status;
+	__u32 flags;
+	__u32 buf_index;
+};
+
+/**
+ * struct akida_xfer_list - Transfer list, argument of AKIDA_IOCTL_XFER
+ * @xfers: User pointer to an array of struct akida_xfer
+ * @nr_xfers: Number of transfers in the array, up to AKIDA_XFER_MAX
+ * @flags: AKIDA_XFER_LIST_LATENCY, or 0 for the class of the file
+ *
+ * All the transfers are checked before any of them is started. They are
+ * spread over the DMA channels and run concurrently, with no ordering
+ * between them. The ioctl returns once all the transfers are done, their
+ * status being updated in the array.
+ */
+struct akida_xfer_list {
+	__u64 xfers;
+	__u32 nr_xfers;
+	__u32 flags;
+};
+
+#define AKIDA_IOCTL_XFER	_IOWR(AKIDA_IOCTL_MAGIC, 0x00, struct akida_xfer_list)
+
+/*
+ * Submission and completion rings
+ *
+ * AKIDA_IOCTL_RING_SETUP creates a submission ring (SQ) and a completion
+ * ring (CQ), shared with the driver by mmap() at AKIDA_RING_MMAP_OFFSET.
+ * The mapping starts with a struct akida_ring_hdr giving the offsets of the
+ * struct akida_sqe and struct akida_cqe arrays.
+ *
+ * Userspace fills the SQ entry at index sq_tail & sq_mask then increments
+ * sq_tail (store release). The driver consumes entries from sq_head and
+ * posts one CQ entry per transfer, incrementing cq_tail (store release).
+ * Userspace reaps CQ entries from cq_head and increments cq_head.
+ *
+ * Without AKIDA_RING_SETUP_SQPOLL, entries are consumed by
+ * AKIDA_IOCTL_RING_ENTER. With it, a kernel thread polls the SQ, and sleeps
+ * after sq_thread_idle ms without entries, setting AKIDA_RING_SQ_NEED_WAKEUP
+ * in sq_flags: AKIDA_IOCTL_RING_ENTER with AKIDA_RING_ENTER_SQ_WAKEUP wakes
+ * it up. AKIDA_RING_SETUP_SQPOLL requires CAP_SYS_NICE.
+ */
+#define AKIDA_RING_MMAP_OFFSET	0x100000000ULL
+#define AKIDA_RING_ENTRIES_MAX	4096
+
+/* struct akida_ring_params flags */
+#define AKIDA_RING_SETUP_SQPOLL		(1U << 0)
+
+/* struct akida_ring_hdr sq_flags */
+#define AKIDA_RING_SQ_NEED_WAKEUP	(1U << 0)
+
+/* struct akida_ring_enter flags */
+#define AKIDA_RING_ENTER_GETEVENTS	(1U << 0)
+#define AKIDA_RING_ENTER_SQ_WAKEUP	(1U << 1)
+
+/**
+ * struct akida_sqe - Submission ring entry
+ * @dev_addr: Device address, as the offset used with pread()/pwrite()
+ * @user_addr: User buffer address, or with AKIDA_XFER_FIXED_BUF the offset
+ *             in the registered buffer buf_index
+ * @len: Transfer length in bytes
+ * @user_data: Copied as is in the completion ring entry
+ * @dir: AKIDA_XFER_TO_DEV or AKIDA_XFER_FROM_DEV
+ * @flags: AKIDA_XFER_FIXED_BUF
+ * @buf_index: Registered buffer index with AKIDA_XFER_FIXED_BUF, else 0
+ * @resv: Must be 0
+ */
+struct akida_sqe {
+	__u64 dev_addr;
+	__u64 user_addr;
+	__u64 len;
+	__u64 user_data;
+	__u32 dir;
+	__u32 flags;
+	__u32 buf_index;
+	__u32 resv;
+};
+
+/**
+ * struct akida_cqe - Completion ring entry
+ * @user_data: user_data of the submission ring entry
+ * @res: Transfer length on success or a negative error code
+ * @flags: Reserved
+ */
+struct akida_cqe {
+	__u64 user_data;
+	__s32 res;
+	__u32 flags;
+};
+
+/**
+ * struct akida_ring_hdr - Header of the rings mapping
+ * @sq_head: SQ consumer index, written by the driver
+ * @sq_tail: SQ producer index, written by userspace
+ * @sq_mask: SQ entries - 1
+ * @sq_flags: AKIDA_RING_SQ_NEED_WAKEUP, written by the driver
+ * @cq_head: CQ consumer index, written by userspace
+ * @cq_tail: CQ producer index, written by the driver
+ * @cq_mask: CQ entries - 1
+ * @resv: Reserved
+ * @sqes_off: Offset of the SQ entries in the mapping
+ * @cqes_off: Offset of the CQ entries in the mapping
+ */
+struct akida_ring_hdr {
+	__u32 sq_head;
+	__u32 sq_tail;
+	__u32 sq_mask;
+	__u32 sq_flags;
+	__u32 cq_head;
+	__u32 cq_tail;
+	__u32 cq_mask;
+	__u32 resv;
+	__u64 sqes_off;
+	__u64 cqes_off;
+};
+
+/**
+ * struct akida_ring_params - Argument of AKIDA_IOCTL_RING_SETUP
+ * @sq_entries: Number of SQ entries, a power of 2 up to AKIDA_RING_ENTRIES_MAX
+ * @cq_entries: Number of CQ entries, a power of 2 not lower than sq_entries,
+ *              or 0 for twice sq_entries
+ * @flags: AKIDA_RING_SETUP_SQPOLL
+ * @sq_thread_idle: Kernel thread idle time before sleeping in ms, 0 for 1s
+ * @size: Set by the driver, size of the mapping
+ */
+struct akida_ring_params {
+	__u32 sq_entries;
+	__u32 cq_entries;
+	__u32 flags;
+	__u32 sq_thread_idle;
+	__u64 size;
+};
+
+/**
+ * struct akida_ring_enter - Argument of AKIDA_IOCTL_RING_ENTER
+ * @to_submit: Maximum number of SQ entries to consume, ignored with
+ *             AKIDA_RING_SETUP_SQPOLL
+ * @min_complete: With AKIDA_RING_ENTER_GETEVENTS, wait until at least this
+ *                number of CQ entries are available
+ * @flags: AKIDA_RING_ENTER_GETEVENTS, AKIDA_RING_ENTER_SQ_WAKEUP
+ * @resv: Must be 0
+ *
+ * The ioctl returns the number of SQ entries consumed.
+ */
+struct akida_ring_enter {
+	__u32 to_submit;
+	__u32 min_complete;
+	__u32 flags;
+	__u32 resv;
+};
+
+#define AKIDA_IOCTL_RING_SETUP	_IOWR(AKIDA_IOCTL_MAGIC, 0x01, struct akida_ring_params)
+#define AKIDA_IOCTL_RING_ENTER	_IOW(AKIDA_IOCTL_MAGIC, 0x02, struct akida_ring_enter)
+
+/*
+ * DMA-BUF
+ *
+ * AKIDA_IOCTL_DMABUF_EXPORT exports a slice of the AKD1500 host DDR area as a
+ * dma-buf, e.g. to have frames written to it by another device. The device
+ * reaches the slice at the host DDR base (0xc0000000) plus its offset.
+ *
+ * AKIDA_IOCTL_DMABUF_XFER transfers data between a dma-buf of another
+ * exporter and the device, the DMA using the dma-buf pages directly.
+ */
+
+/**
+ * struct akida_dmabuf_export - Argument of AKIDA_IOCTL_DMABUF_EXPORT
+ * @offset: Offset of the slice in the host DDR area, page aligned
+ * @size: Size of the slice, page aligned
+ * @flags: O_CLOEXEC and the access mode (O_RDONLY, O_RDWR) of the dma-buf fd
+ * @fd: Set by the driver, dma-buf file descriptor
+ */
+struct akida_dmabuf_export {
+	__u64 offset;
+	__u64 size;
+	__u32 flags;
+	__s32 fd;
+};
+
+/**
+ * struct akida_dmabuf_xfer - Argument of AKIDA_IOCTL_DMABUF_XFER
+ * @fd: dma-buf file descriptor
+ * @dir: AKIDA_XFER_TO_DEV (dma-buf to device) or AKIDA_XFER_FROM_DEV
+ * @offset: Offset in the dma-buf
+ * @len: Transfer length in bytes
+ * @dev_addr: Device address, as the offset used with pread()/pwrite()
+ *
+ * The transfer waits for the fences of the dma-buf, i.e. for the pending
+ * writes (and reads with AKIDA_XFER_FROM_DEV) of other devices.
+ */
+struct akida_dmabuf_xfer {
+	__s32 fd;
+	__u32 dir;
+	__u64 offset;
+	__u64 len;
+	__u64 dev_addr;
+};
+
+#define AKIDA_IOCTL_DMABUF_EXPORT	_IOWR(AKIDA_IOCTL_MAGIC, 0x03, struct akida_dmabuf_export)
+#define AKIDA_IOCTL_DMABUF_XFER		_IOW(AKIDA_IOCTL_MAGIC, 0x04, struct akida_dmabuf_xfer)
+
+/*
+ * Registered buffers
+ *
+ * AKIDA_IOCTL_BUF_REGISTER pins and DMA maps user buffers once, for the file
+ * descriptor lifetime or until AKIDA_IOCTL_BUF_UNREGISTER. Transfers of
+ * AKIDA_IOCTL_XFER and the rings with AKIDA_XFER_FIXED_BUF then select a
+ * registered buffer by its index and use a part of it directly, with no per
+ * transfer pinning nor mapping. Other transfers never use registered
+ * buffers, even if their user address falls within one.
+ * Registered buffers must be aligned on the cache line size. Their pages are
+ * charged to the RLIMIT_MEMLOCK of the process unless it has CAP_IPC_LOCK.
+ */
+#define AKIDA_BUF_MAX		64
+
+/**
+ * struct akida_buf - One buffer to register
+ * @addr: User buffer address
+ * @len: Buffer length in bytes
+ */
+struct akida_buf {
+	__u64 addr;
+	__u64 len;
+};
+
+/**
+ * struct akida_buf_register - Argument of AKIDA_IOCTL_BUF_REGISTER
+ * @bufs: User pointer to an array of struct akida_buf
+ * @nr_bufs: Number of buffers in the array
+ * @index: Set by the driver, index of the first buffer, the buffers getting
+ *         consecutive indexes
+ */
+struct akida_buf_register {
+	__u64 bufs;
+	__u32 nr_bufs;
+	__u32 index;
+};
+
+/**
+ * struct akida_buf_unregister - Argument of AKIDA_IOCTL_BUF_UNREGISTER
+ * @index: Index of the first buffer to unregister
+ * @nr_bufs: Number of buffers to unregister
+ *
+ * Transfers in flight keep using a buffer until they are done.
+ */
+struct akida_buf_unregister {
+	__u32 index;
+	__u32 nr_bufs;
+};
+
+#define AKIDA_IOCTL_BUF_REGISTER	_IOWR(AKIDA_IOCTL_MAGIC, 0x05, struct akida_buf_register)
+#define AKIDA_IOCTL_BUF_UNREGISTER	_IOW(AKIDA_IOCTL_MAGIC, 0x06, struct akida_buf_unregister)
+
+/*
+ * Channel binding
+ *
+ * AKIDA_IOCTL_CHAN_BIND binds a DMA channel of each requested direction to
+ * the file descriptor, until it is unbound or the file is closed. The
+ * synchronous transfers of pread()/pwrite(), AKIDA_IOCTL_XFER and the rings
+ * then use the bound channel, with no contention with other files, while
+ * asynchronous transfers keep using the shared channels. At least one
+ * channel of each direction is left for the files without binding: binding
+ * fails with EBUSY otherwise.
+ */
+#define AKIDA_CHAN_BIND_RX	(1U << 0)	/* Device to host */
+#define AKIDA_CHAN_BIND_TX	(1U << 1)	/* Host to device */
+
+/**
+ * struct akida_chan_bind - Argument of AKIDA_IOCTL_CHAN_BIND
+ * @flags: Directions to bind, AKIDA_CHAN_BIND_RX and/or AKIDA_CHAN_BIND_TX,
+ *         the directions not set are unbound
+ */
+struct akida_chan_bind {
+	__u32 flags;
+};
+
+#define AKIDA_IOCTL_CHAN_BIND		_IOW(AKIDA_IOCTL_MAGIC, 0x07, struct akida_chan_bind)
+
+/*
+ * Transfer classes
+ *
+ * Transfers waiting for a DMA channel are served by class: latency class
+ * transfers go before bulk class ones, and bulk transfers of pread()/pwrite()
+ * larger than the qos_slice module parameter are done by slices, giving
+ * their channels to waiting latency transfers between slices.
+ * The class is set per file by AKIDA_IOCTL_SET_QOS (bulk by default), and
+ * per call by RWF_HIPRI or AKIDA_XFER_LIST_LATENCY which select the latency
+ * class.
+ */
+#define AKIDA_QOS_BULK		0
+#define AKIDA_QOS_LATENCY	1
+
+/**
+ * struct akida_set_qos - Argument of AKIDA_IOCTL_SET_QOS
+ * @qos_class: AKIDA_QOS_BULK or AKIDA_QOS_LATENCY
+ * @flags: Must be 0
+ */
+struct akida_set_qos {
+	__u32 qos_class;
+	__u32 flags;
+};
+
+#define AKIDA_IOCTL_SET_QOS		_IOW(AKIDA_IOCTL_MAGIC, 0x08, struct akida_set_qos)
+
+/*
+ * Write-combining mappings
+ *
+ * mmap() maps the device memory uncached at its device address. Adding
+ * AKIDA_MMAP_WC_OFFSET to the offset maps it write-combining instead, so
+ * that bulk stores are merged into bursts. Only the part of the AKD1500 DMA
+ * RAM set by the dma_ram_wc_size module parameter can be mapped that way,
+ * and it can't be mapped uncached. Stores may be reordered and stay
+ * buffered until a store fence.
+ */
+#define AKIDA_MMAP_WC_OFFSET	0x200000000ULL
+
+/*
+ * Host DDR synchronization
+ *
+ * With the host_ddr_cached module parameter, the AKD1500 host DDR area is
+ * mapped cacheable by mmap(): the CPU accesses to a range must then be
+ * bracketed by AKIDA_IOCTL_HOST_DDR_SYNC with AKIDA_HOST_DDR_SYNC_START and
+ * AKIDA_HOST_DDR_SYNC_END, as DMA_BUF_IOCTL_SYNC does for a dma-buf.
+ * Otherwise the area is coherent and the ioctl does nothing.
+ */
+#define AKIDA_HOST_DDR_SYNC_READ	(1U << 0)	/* CPU reads the range */
+#define AKIDA_HOST_DDR_SYNC_WRITE	(1U << 1)	/* CPU writes the range */
+#define AKIDA_HOST_DDR_SYNC_RW		(AKIDA_HOST_DDR_SYNC_READ | AKIDA_HOST_DDR_SYNC_WRITE)
+#define AKIDA_HOST_DDR_SYNC_START	(0U << 2)	/* Before the CPU accesses */
+#define AKIDA_HOST_DDR_SYNC_END		(1U << 2)	/* After the CPU accesses */
+
+/**
+ * struct akida_host_ddr_sync - Argument of AKIDA_IOCTL_HOST_DDR_SYNC
+ * @offset: Offset of the range in the host DDR area
+ * @size: Size of the range
+ * @flags: AKIDA_HOST_DDR_SYNC_START or AKIDA_HOST_DDR_SYNC_END, and the
+ *         accesses (AKIDA_HOST_DDR_SYNC_READ, WRITE or RW)
+ * @reserved: Must be 0
+ */
+struct akida_host_ddr_sync {
+	__u64 offset;
+	__u64 size;
+	__u32 flags;
+	__u32 reserved;
+};
+
+#define AKIDA_IOCTL_HOST_DDR_SYNC	_IOW(AKIDA_IOCTL_MAGIC, 0x09, struct akida_host_ddr_sync)
+
+/*
+ * Outbound windows
+ *
+ * AKIDA_IOCTL_WIN_MAP pins and DMA maps a user buffer, like a hugetlbfs
+ * mapping, and makes the AKD1500 see it at dev_addr, through its spare
+ * outbound regions: the device DMA and the model then access the buffer
+ * directly, without copy. Each DMA contiguous segment of the buffer takes a
+ * region, AKIDA_WIN_REGIONS_MAX for the whole device, so the buffer must be
+ * physically contiguous or behind an IOMMU. addr, len and dev_addr must be
+ * aligned on AKIDA_WIN_ALIGN, and the window must fit in
+ * [AKIDA_WIN_DEV_BASE, AKIDA_WIN_DEV_BASE + AKIDA_WIN_DEV_SIZE). A window is
+ * removed by AKIDA_IOCTL_WIN_UNMAP, or when the file is closed. Transfers of
+ * a file to that range are only accepted within one of its own windows.
+ */
+#define AKIDA_WIN_DEV_BASE	0xd0000000
+#define AKIDA_WIN_DEV_SIZE	0x10000000
+#define AKIDA_WIN_ALIGN		0x10000
+#define AKIDA_WIN_REGIONS_MAX	3
+
+/**
+ * struct akida_win_map - Argument of AKIDA_IOCTL_WIN_MAP
+ * @addr: User address of the buffer
+ * @len: Length of the buffer
+ * @dev_addr: Device address of the window
+ * @index: Returned index of the window, for AKIDA_IOCTL_WIN_UNMAP
+ */
+struct akida_win_map {
+	__u64 addr;
+	__u64 len;
+	__u32 dev_addr;
+	__u32 index;
+};
+
+/**
+ * struct akida_win_unmap - Argument of AKIDA_IOCTL_WIN_UNMAP
+ * @index: Index returned by AKIDA_IOCTL_WIN_MAP
+ * @flags: Must be 0
+ */
+struct akida_win_unmap {
+	__u32 index;
+	__u32 flags;
+};
+
+#define AKIDA_IOCTL_WIN_MAP	_IOWR(AKIDA_IOCTL_MAGIC, 0x0a, struct akida_win_map)
+#define AKIDA_IOCTL_WIN_UNMAP	_IOW(AKIDA_IOCTL_MAGIC, 0x0b, struct akida_win_unmap)
+
+#endif /* _AKIDA_PCIE_H */
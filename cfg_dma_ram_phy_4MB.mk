@@ -1,25 +1,13 @@
 AKIDA_DMA_RAM_PHY_ADDR = 0x20000000
 AKIDA_DMA_RAM_PHY_OFFSET =      0x0
 
-# Linked-list: 1MB at 0x000000000 offset, split in 4 area (512kB each)
-AKIDA_DMA_RAM_PHY_TX0_LL_OFFSET =  0x00000000 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_TX0_LL_SIZE   =     0x40000
-AKIDA_DMA_RAM_PHY_TX1_LL_OFFSET =  0x00040000 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_TX1_LL_SIZE   =     0x40000
-AKIDA_DMA_RAM_PHY_RX0_LL_OFFSET =  0x00080000 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_RX0_LL_SIZE   =     0x40000
-AKIDA_DMA_RAM_PHY_RX1_LL_OFFSET =  0x000C0000 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_RX1_LL_SIZE   =     0x40000
+# Linked-list: 1MB at 0x000000000 offset, split between the channels
+AKIDA_DMA_RAM_PHY_LL_OFFSET =  0x00000000 + AKIDA_DMA_RAM_PHY_OFFSET
+AKIDA_DMA_RAM_PHY_LL_SIZE   =    0x100000
 
-# Data: 3MB at 0x001000000 offset, split in 4 area (768kB each)
-AKIDA_DMA_RAM_PHY_TX0_DT_OFFSET =  0x00100000 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_TX0_DT_SIZE   =     0xC0000
-AKIDA_DMA_RAM_PHY_TX1_DT_OFFSET =  0x001C0000 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_TX1_DT_SIZE   =     0xC0000
-AKIDA_DMA_RAM_PHY_RX0_DT_OFFSET =  0x00280000 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_RX0_DT_SIZE   =     0xC0000
-AKIDA_DMA_RAM_PHY_RX1_DT_OFFSET =  0x00340000 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_RX1_DT_SIZE   =     0xC0000
+# Data: 3MB at 0x001000000 offset, split between the channels
+AKIDA_DMA_RAM_PHY_DT_OFFSET =  0x00100000 + AKIDA_DMA_RAM_PHY_OFFSET
+AKIDA_DMA_RAM_PHY_DT_SIZE   =    0x300000
 
 # 4 MB used
 AKIDA_DMA_RAM_PHY_SIZE = 0x00400000
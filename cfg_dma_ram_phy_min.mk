@@ -1,25 +1,14 @@
 AKIDA_DMA_RAM_PHY_ADDR = 0x20000000
 AKIDA_DMA_RAM_PHY_OFFSET =      0x0
 
-# Linked-list: 2 descriptors (2 * 24 bytes) per channel
-AKIDA_DMA_RAM_PHY_TX0_LL_OFFSET =  0x00000000 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_TX0_LL_SIZE   =        0x30
-AKIDA_DMA_RAM_PHY_TX1_LL_OFFSET =  0x00000030 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_TX1_LL_SIZE   =        0x30
-AKIDA_DMA_RAM_PHY_RX0_LL_OFFSET =  0x00000060 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_RX0_LL_SIZE   =        0x30
-AKIDA_DMA_RAM_PHY_RX1_LL_OFFSET =  0x00000090 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_RX1_LL_SIZE   =        0x30
+# Linked-list: 2 descriptors (2 * 24 bytes) per channel, 2 channels per
+# direction
+AKIDA_DMA_RAM_PHY_LL_OFFSET =  0x00000000 + AKIDA_DMA_RAM_PHY_OFFSET
+AKIDA_DMA_RAM_PHY_LL_SIZE   =        0xC0
 
 # Data: Empty
-AKIDA_DMA_RAM_PHY_TX0_DT_OFFSET =  0x00000000 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_TX0_DT_SIZE   =           0
-AKIDA_DMA_RAM_PHY_TX1_DT_OFFSET =  0x00000000 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_TX1_DT_SIZE   =           0
-AKIDA_DMA_RAM_PHY_RX0_DT_OFFSET =  0x00000000 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_RX0_DT_SIZE   =           0
-AKIDA_DMA_RAM_PHY_RX1_DT_OFFSET =  0x00000000 + AKIDA_DMA_RAM_PHY_OFFSET
-AKIDA_DMA_RAM_PHY_RX1_DT_SIZE   =           0
+AKIDA_DMA_RAM_PHY_DT_OFFSET =  0x00000000 + AKIDA_DMA_RAM_PHY_OFFSET
+AKIDA_DMA_RAM_PHY_DT_SIZE   =           0
 
 # 4*2*24 = 192 bytes used
 AKIDA_DMA_RAM_PHY_SIZE = 0x000000C0
@@ -13,5 +13,7 @@
 
 int akida_dw_edma_probe(struct dw_edma_chip *chip);
 int akida_dw_edma_remove(struct dw_edma_chip *chip);
+void akida_dw_edma_set_polled(struct dma_chan *dchan, bool polled);
+bool akida_dw_edma_poll(struct dma_chan *dchan);
 
 #endif /* _AKIDA_DW_EDMA_H */
@@ -55,9 +55,13 @@ enum dw_edma_map_format {
 /**
  * enum dw_edma_chip_flags - Flags specific to an eDMA chip
  * @DW_EDMA_CHIP_LOCAL:		eDMA is used locally by an endpoint
+ * @DW_EDMA_CHIP_LL_MEM:	linked lists are in memory (vaddr.mem) of the
+ *				remote host, reached by the eDMA through an
+ *				outbound window
  */
 enum dw_edma_chip_flags {
 	DW_EDMA_CHIP_LOCAL	= BIT(0),
+	DW_EDMA_CHIP_LL_MEM	= BIT(1),
 };
 
 /**
@@ -5,7 +5,9 @@
  *
  * Author: Herve Codina <herve.codina@bootlin.com>
  */
+#define _GNU_SOURCE
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
@@ -13,6 +15,14 @@
 #include <stdint.h>
 #include <inttypes.h>
 #include <pthread.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/aio_abi.h>
+
+#include "akida-pcie.h"
 
 
 static void display_buffer(const char *msg, uint8_t *buff, size_t size)
@@ -241,63 +251,46 @@ end:
 	return &p->err;
 }
 
+#define TEST_MULTITHREAD_MAX 16
+
 static int test_multithread(int fd, int is_verbose, const char *devpath, off_t test_area, unsigned int nb_loop, unsigned int nb_thread)
 {
-	struct thread_param p[3] = {0};
-	pthread_t thread_id[3];
-	int fd1, fd2;
+	struct thread_param p[TEST_MULTITHREAD_MAX] = {0};
+	pthread_t thread_id[TEST_MULTITHREAD_MAX];
+	char name[TEST_MULTITHREAD_MAX][16];
+	struct timespec tstart, tend;
 	int err, err2;
 	unsigned int i, j;
 
-	if (nb_thread > 3) {
+	if (nb_thread > TEST_MULTITHREAD_MAX) {
 		fprintf(stderr,"nb_thread=%u not supported\n", nb_thread);
 		return EINVAL;
 	}
 
-	fd1 = open(devpath, O_RDWR | O_NONBLOCK);
-	if (fd1 < 0) {
-		err = errno;
-		fprintf(stderr,"open(%s) failed (%d-%s)\n",
-			devpath, err, strerror(err));
-		return err;
-	}
+	/* The first thread uses fd, the others their own file */
+	for (i = 0; i < nb_thread; i++) {
+		snprintf(name[i], sizeof(name[i]), "thread%u", i);
+		p[i].name = name[i];
+		p[i].devpath = devpath;
+		p[i].fd = fd;
+		p[i].is_verbose = is_verbose;
+		p[i].test_area = test_area + i * TEST3_BUFFER_SIZE; /* Do not overlap with other thread */
+		p[i].nb_loop = nb_loop;
+		p[i].err = EINPROGRESS;
+		if (!i)
+			continue;
 
-	fd2 = open(devpath, O_RDWR | O_NONBLOCK);
-	if (fd2 < 0) {
-		err = errno;
-		fprintf(stderr,"open(%s) failed (%d-%s)\n",
-			devpath, err, strerror(err));
-		close(fd1);
-		return err;
+		p[i].fd = open(devpath, O_RDWR | O_NONBLOCK);
+		if (p[i].fd < 0) {
+			err = errno;
+			fprintf(stderr,"open(%s) failed (%d-%s)\n",
+				devpath, err, strerror(err));
+			nb_thread = i;
+			goto end;
+		}
 	}
 
-	p[0].name = "thread0";
-	p[0].devpath = devpath;
-	p[0].fd = fd;
-	p[0].is_verbose = is_verbose;
-	p[0].test_area = test_area;
-	p[0].nb_loop = nb_loop;
-	p[0].is_verbose = is_verbose;
-	p[0].err = EINPROGRESS;
-
-	p[1].name = "thread1";
-	p[1].devpath = devpath;
-	p[1].fd = fd1;
-	p[1].is_verbose = is_verbose;
-	p[1].test_area = test_area + 1 * TEST3_BUFFER_SIZE ; /* Do not overlap with other thread */
-	p[1].nb_loop = nb_loop;
-	p[1].is_verbose = is_verbose;
-	p[1].err = EINPROGRESS;
-
-	p[2].name = "thread2";
-	p[2].devpath = devpath;
-	p[2].fd = fd2;
-	p[2].is_verbose = is_verbose;
-	p[2].test_area = test_area + 2 * TEST3_BUFFER_SIZE; /* Do not overlap with other thread */
-	p[2].nb_loop = nb_loop;
-	p[2].is_verbose = is_verbose;
-	p[2].err = EINPROGRESS;
-
+	clock_gettime(CLOCK_MONOTONIC, &tstart);
 	for (i = 0; i < nb_thread; i++) {
 		err = pthread_create(&thread_id[i], NULL, thread_fct, &p[i]);
 		if (err) {
@@ -319,20 +312,25 @@ static int test_multithread(int fd, int is_verbose, const char *devpath, off_t t
 				err = err2;
 		}
 	}
+	clock_gettime(CLOCK_MONOTONIC, &tend);
 	if (err)
 		goto end;
 
 	err = 0;
-	for (i = 0; i < 2; i++) {
+	for (i = 0; i < nb_thread; i++) {
 		if (p[i].err) {
 			err = p[i].err;
 			goto end;
 		}
 	}
 
+	printf("%u threads x %u loops in %.3f s\n", nb_thread, nb_loop,
+		(tend.tv_sec - tstart.tv_sec) +
+		(tend.tv_nsec - tstart.tv_nsec) / 1e9);
+
 end:
-	close(fd2);
-	close(fd1);
+	for (i = 1; i < nb_thread; i++)
+		close(p[i].fd);
 	return err;
 }
 
@@ -356,6 +354,1342 @@ static int test7(int fd, int is_verbose, const char *devpath, off_t test_area)
 	return test_multithread(fd, 0, devpath, test_area, 100, 3);
 }
 
+static int test19(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Contention on the DMA channels: more threads than channels */
+	return test_multithread(fd, 0, devpath, test_area, 20, 8);
+}
+
+static double elapsed_sec(const struct timespec *tstart, const struct timespec *tend)
+{
+	return (tend->tv_sec - tstart->tv_sec) +
+		(tend->tv_nsec - tstart->tv_nsec) / 1e9;
+}
+
+static int test8(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Throughput of large transfers. Page aligned buffers are eligible to
+	 * the zero-copy path, compare with the bounce path by setting
+	 * /sys/module/akida_pcie/parameters/zero_copy to N.
+	 */
+#define TEST8_BUFFER_SIZE (512*1024)
+#define TEST8_NB_LOOP 32
+	struct timespec tstart, tend;
+	uint8_t *buff[2];
+	unsigned int loop;
+	size_t size;
+	ssize_t ssize;
+	double sec;
+	int err;
+
+	err = posix_memalign((void **)&buff[0], 4096, TEST8_BUFFER_SIZE);
+	if (err) {
+		fprintf(stderr,"posix_memalign(%d) failed (%d-%s)\n",
+			TEST8_BUFFER_SIZE, err, strerror(err));
+		return err;
+	}
+	err = posix_memalign((void **)&buff[1], 4096, TEST8_BUFFER_SIZE);
+	if (err) {
+		fprintf(stderr,"posix_memalign(%d) failed (%d-%s)\n",
+			TEST8_BUFFER_SIZE, err, strerror(err));
+		free(buff[0]);
+		return err;
+	}
+
+	for (size = 0; size < TEST8_BUFFER_SIZE; size++)
+		buff[0][size] = size * 7;
+	memset(buff[1], 0, TEST8_BUFFER_SIZE);
+
+	clock_gettime(CLOCK_MONOTONIC, &tstart);
+	for (loop = 0; loop < TEST8_NB_LOOP; loop++) {
+		ssize = pwrite(fd, buff[0], TEST8_BUFFER_SIZE, test_area);
+		if (ssize != TEST8_BUFFER_SIZE) {
+			err = ssize < 0 ? errno : ECANCELED;
+			fprintf(stderr,"pwrite(%d,0x%lx) failed (%d-%s)\n",
+				TEST8_BUFFER_SIZE, test_area, err, strerror(err));
+			goto end;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &tend);
+	sec = elapsed_sec(&tstart, &tend);
+	if (is_verbose)
+		printf("Wr @0x%04lx, %d x %d bytes, %.1f MB/s\n", test_area,
+			TEST8_NB_LOOP, TEST8_BUFFER_SIZE,
+			TEST8_NB_LOOP * (TEST8_BUFFER_SIZE / 1e6) / sec);
+
+	clock_gettime(CLOCK_MONOTONIC, &tstart);
+	for (loop = 0; loop < TEST8_NB_LOOP; loop++) {
+		ssize = pread(fd, buff[1], TEST8_BUFFER_SIZE, test_area);
+		if (ssize != TEST8_BUFFER_SIZE) {
+			err = ssize < 0 ? errno : ECANCELED;
+			fprintf(stderr,"pread(%d,0x%lx) failed (%d-%s)\n",
+				TEST8_BUFFER_SIZE, test_area, err, strerror(err));
+			goto end;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &tend);
+	sec = elapsed_sec(&tstart, &tend);
+	if (is_verbose)
+		printf("Rd @0x%04lx, %d x %d bytes, %.1f MB/s\n", test_area,
+			TEST8_NB_LOOP, TEST8_BUFFER_SIZE,
+			TEST8_NB_LOOP * (TEST8_BUFFER_SIZE / 1e6) / sec);
+
+	err = 0;
+	for (size = 0; size < TEST8_BUFFER_SIZE; size++) {
+		if (buff[0][size] != buff[1][size]) {
+			printf("Mismatch at offset %zu (read 0x%02"PRIx8", exp 0x%02"PRIx8")\n",
+				size,
+				buff[1][size],
+				buff[0][size]);
+			err = EILSEQ;
+			goto end;
+		}
+	}
+	if (is_verbose)
+		printf("Data ok\n");
+
+end:
+	free(buff[1]);
+	free(buff[0]);
+	return err;
+}
+
+static int test9_aio(aio_context_t ctx, int fd, uint16_t opcode, uint8_t **buff,
+		     size_t size, unsigned int nb, off_t test_area)
+{
+	struct iocb iocb[nb], *piocb[nb];
+	struct io_event events[nb];
+	unsigned int done;
+	unsigned int i;
+	long ret;
+	int err;
+
+	memset(iocb, 0, sizeof(iocb));
+	for (i = 0; i < nb; i++) {
+		iocb[i].aio_fildes = fd;
+		iocb[i].aio_lio_opcode = opcode;
+		iocb[i].aio_buf = (uintptr_t)buff[i];
+		iocb[i].aio_nbytes = size;
+		iocb[i].aio_offset = test_area + i * size;
+		iocb[i].aio_data = i;
+		piocb[i] = &iocb[i];
+	}
+
+	ret = syscall(SYS_io_submit, ctx, nb, piocb);
+	if (ret != (long)nb) {
+		err = ret < 0 ? errno : ECANCELED;
+		fprintf(stderr,"io_submit(%u) failed (%d-%s)\n",
+			nb, err, strerror(err));
+		return err;
+	}
+
+	for (done = 0; done < nb; done += ret) {
+		ret = syscall(SYS_io_getevents, ctx, 1, nb - done, events, NULL);
+		if (ret < 0) {
+			err = errno;
+			fprintf(stderr,"io_getevents() failed (%d-%s)\n",
+				err, strerror(err));
+			return err;
+		}
+		for (i = 0; i < ret; i++) {
+			if (events[i].res != (int64_t)size) {
+				fprintf(stderr,"aio %"PRIu64" returns %"PRId64"\n",
+					(uint64_t)events[i].data, (int64_t)events[i].res);
+				return ECANCELED;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int test9(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Several asynchronous transfers in flight from a single thread */
+#define TEST9_BUFFER_SIZE (64*1024)
+#define TEST9_NB_AIO 4
+	uint8_t *buff[2][TEST9_NB_AIO] = {0};
+	aio_context_t ctx = 0;
+	unsigned int i;
+	size_t size;
+	int err;
+
+	if (syscall(SYS_io_setup, TEST9_NB_AIO, &ctx) < 0) {
+		err = errno;
+		fprintf(stderr,"io_setup() failed (%d-%s)\n", err, strerror(err));
+		return err;
+	}
+
+	for (i = 0; i < 2 * TEST9_NB_AIO; i++) {
+		err = posix_memalign((void **)&buff[i % 2][i / 2], 4096,
+				     TEST9_BUFFER_SIZE);
+		if (err) {
+			fprintf(stderr,"posix_memalign(%d) failed (%d-%s)\n",
+				TEST9_BUFFER_SIZE, err, strerror(err));
+			goto end;
+		}
+	}
+
+	for (i = 0; i < TEST9_NB_AIO; i++) {
+		for (size = 0; size < TEST9_BUFFER_SIZE; size++)
+			buff[0][i][size] = size * 3 + i;
+		memset(buff[1][i], 0, TEST9_BUFFER_SIZE);
+	}
+
+	err = test9_aio(ctx, fd, IOCB_CMD_PWRITE, buff[0], TEST9_BUFFER_SIZE,
+			TEST9_NB_AIO, test_area);
+	if (err)
+		goto end;
+	if (is_verbose)
+		printf("Wr @0x%04lx, %d x %d bytes\n", test_area,
+			TEST9_NB_AIO, TEST9_BUFFER_SIZE);
+
+	err = test9_aio(ctx, fd, IOCB_CMD_PREAD, buff[1], TEST9_BUFFER_SIZE,
+			TEST9_NB_AIO, test_area);
+	if (err)
+		goto end;
+	if (is_verbose)
+		printf("Rd @0x%04lx, %d x %d bytes\n", test_area,
+			TEST9_NB_AIO, TEST9_BUFFER_SIZE);
+
+	for (i = 0; i < TEST9_NB_AIO; i++) {
+		if (memcmp(buff[0][i], buff[1][i], TEST9_BUFFER_SIZE)) {
+			printf("Mismatch in aio %u\n", i);
+			err = EILSEQ;
+			goto end;
+		}
+	}
+	if (is_verbose)
+		printf("Data ok\n");
+
+end:
+	for (i = 0; i < 2 * TEST9_NB_AIO; i++)
+		free(buff[i % 2][i / 2]);
+	syscall(SYS_io_destroy, ctx);
+	return err;
+}
+
+static int test10_rw(int fd, int is_verbose, const size_t *tab_size,
+		     unsigned int nb, off_t test_area)
+{
+	struct iovec iov[2][nb];
+	unsigned int i;
+	size_t total;
+	size_t size;
+	ssize_t ssize;
+	int err;
+
+	memset(iov, 0, sizeof(iov));
+	total = 0;
+	for (i = 0; i < nb; i++) {
+		iov[0][i].iov_len = tab_size[i];
+		iov[1][i].iov_len = tab_size[i];
+		err = posix_memalign(&iov[0][i].iov_base, 4096, tab_size[i]);
+		if (!err)
+			err = posix_memalign(&iov[1][i].iov_base, 4096, tab_size[i]);
+		if (err) {
+			fprintf(stderr,"posix_memalign(%zu) failed (%d-%s)\n",
+				tab_size[i], err, strerror(err));
+			goto end;
+		}
+		for (size = 0; size < tab_size[i]; size++)
+			((uint8_t *)iov[0][i].iov_base)[size] = size * 5 + i;
+		memset(iov[1][i].iov_base, 0, tab_size[i]);
+		total += tab_size[i];
+	}
+
+	ssize = pwritev(fd, iov[0], nb, test_area);
+	if (ssize != (ssize_t)total) {
+		err = ssize < 0 ? errno : ECANCELED;
+		fprintf(stderr,"pwritev(%u,%zu,0x%lx) failed (%d-%s)\n",
+			nb, total, test_area, err, strerror(err));
+		goto end;
+	}
+
+	ssize = preadv(fd, iov[1], nb, test_area);
+	if (ssize != (ssize_t)total) {
+		err = ssize < 0 ? errno : ECANCELED;
+		fprintf(stderr,"preadv(%u,%zu,0x%lx) failed (%d-%s)\n",
+			nb, total, test_area, err, strerror(err));
+		goto end;
+	}
+
+	if (is_verbose)
+		printf("Wr/Rd @0x%04lx, %u buffers, %zu bytes\n", test_area,
+			nb, total);
+
+	err = 0;
+	for (i = 0; i < nb; i++) {
+		if (memcmp(iov[0][i].iov_base, iov[1][i].iov_base, tab_size[i])) {
+			printf("Mismatch in buffer %u\n", i);
+			err = EILSEQ;
+			goto end;
+		}
+	}
+	if (is_verbose)
+		printf("Data ok\n");
+
+end:
+	for (i = 0; i < nb; i++) {
+		free(iov[1][i].iov_base);
+		free(iov[0][i].iov_base);
+	}
+	return err;
+}
+
+static int test10(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Vectored transfers, gathered in the bounce buffers (unaligned
+	 * sizes) or in a single scatter-gather list (aligned sizes).
+	 */
+	static const size_t tab_unaligned[] = {100, 64*1024, 28, 4096 + 3};
+	static const size_t tab_aligned[] = {4096, 64*1024, 256, 32*1024};
+	int err;
+
+	err = test10_rw(fd, is_verbose, tab_unaligned,
+			sizeof(tab_unaligned)/sizeof(tab_unaligned[0]),
+			test_area);
+	if (err)
+		return err;
+
+	return test10_rw(fd, is_verbose, tab_aligned,
+			 sizeof(tab_aligned)/sizeof(tab_aligned[0]),
+			 test_area);
+}
+
+static int test11(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Batch of small writes then small reads at different device
+	 * addresses, and a large one, in a single ioctl each.
+	 */
+#define TEST11_NB_XFER 16
+#define TEST11_XFER_SIZE 1000
+#define TEST11_LARGE_SIZE (128*1024)
+	struct akida_xfer xfer[2][TEST11_NB_XFER + 1];
+	struct akida_xfer_list list;
+	uint8_t *buff[2];
+	size_t total;
+	size_t size;
+	unsigned int d, i;
+	int err;
+
+	total = TEST11_NB_XFER * TEST11_XFER_SIZE + TEST11_LARGE_SIZE;
+	err = posix_memalign((void **)&buff[0], 4096, total);
+	if (err) {
+		fprintf(stderr,"posix_memalign(%zu) failed (%d-%s)\n",
+			total, err, strerror(err));
+		return err;
+	}
+	err = posix_memalign((void **)&buff[1], 4096, total);
+	if (err) {
+		fprintf(stderr,"posix_memalign(%zu) failed (%d-%s)\n",
+			total, err, strerror(err));
+		free(buff[0]);
+		return err;
+	}
+
+	for (size = 0; size < total; size++)
+		buff[0][size] = size * 11;
+	memset(buff[1], 0, total);
+
+	/* Spread the device addresses, in reverse order of the buffers */
+	for (d = 0; d < 2; d++) {
+		for (i = 0; i < TEST11_NB_XFER; i++) {
+			xfer[d][i].dev_addr = test_area +
+				(TEST11_NB_XFER - 1 - i) * 2 * TEST11_XFER_SIZE;
+			xfer[d][i].user_addr = (uintptr_t)(buff[d] + i * TEST11_XFER_SIZE);
+			xfer[d][i].len = TEST11_XFER_SIZE;
+			xfer[d][i].dir = d ? AKIDA_XFER_FROM_DEV : AKIDA_XFER_TO_DEV;
+			xfer[d][i].status = 1;
+			xfer[d][i].flags = 0;
+			xfer[d][i].buf_index = 0;
+		}
+		xfer[d][i].dev_addr = test_area + 2 * TEST11_NB_XFER * TEST11_XFER_SIZE;
+		xfer[d][i].user_addr = (uintptr_t)(buff[d] + i * TEST11_XFER_SIZE);
+		xfer[d][i].len = TEST11_LARGE_SIZE;
+		xfer[d][i].dir = d ? AKIDA_XFER_FROM_DEV : AKIDA_XFER_TO_DEV;
+		xfer[d][i].status = 1;
+		xfer[d][i].flags = 0;
+		xfer[d][i].buf_index = 0;
+
+		list.xfers = (uintptr_t)xfer[d];
+		list.nr_xfers = TEST11_NB_XFER + 1;
+		list.flags = 0;
+		if (ioctl(fd, AKIDA_IOCTL_XFER, &list) < 0) {
+			err = errno;
+			fprintf(stderr,"ioctl(AKIDA_IOCTL_XFER, %s) failed (%d-%s)\n",
+				d ? "rd" : "wr", err, strerror(err));
+			goto end;
+		}
+		for (i = 0; i <= TEST11_NB_XFER; i++) {
+			if (xfer[d][i].status) {
+				fprintf(stderr,"xfer %u %s status %d\n",
+					i, d ? "rd" : "wr", xfer[d][i].status);
+				err = ECANCELED;
+				goto end;
+			}
+		}
+		if (is_verbose)
+			printf("%s @0x%04lx, %d x %d + %d bytes\n", d ? "Rd" : "Wr",
+				test_area, TEST11_NB_XFER, TEST11_XFER_SIZE,
+				TEST11_LARGE_SIZE);
+	}
+
+	err = 0;
+	for (size = 0; size < total; size++) {
+		if (buff[0][size] != buff[1][size]) {
+			printf("Mismatch at offset %zu (read 0x%02"PRIx8", exp 0x%02"PRIx8")\n",
+				size,
+				buff[1][size],
+				buff[0][size]);
+			err = EILSEQ;
+			goto end;
+		}
+	}
+	if (is_verbose)
+		printf("Data ok\n");
+
+end:
+	free(buff[1]);
+	free(buff[0]);
+	return err;
+}
+
+struct test12_ring {
+	struct akida_ring_hdr *hdr;
+	struct akida_sqe *sqes;
+	struct akida_cqe *cqes;
+	size_t size;
+};
+
+static int test12_run(int fd, struct test12_ring *ring, uint32_t flags,
+		      uint8_t *buff, size_t size, unsigned int nb, uint32_t dir,
+		      off_t test_area)
+{
+	struct akida_ring_enter enter;
+	struct akida_sqe *sqe;
+	struct akida_cqe *cqe;
+	uint32_t tail, head;
+	unsigned int i, done;
+	int err;
+
+	tail = ring->hdr->sq_tail;
+	for (i = 0; i < nb; i++) {
+		sqe = &ring->sqes[(tail + i) & ring->hdr->sq_mask];
+		sqe->dev_addr = test_area + i * size;
+		sqe->user_addr = (uintptr_t)(buff + i * size);
+		sqe->len = size;
+		sqe->user_data = i;
+		sqe->dir = dir;
+		sqe->flags = 0;
+		sqe->buf_index = 0;
+		sqe->resv = 0;
+	}
+	__atomic_store_n(&ring->hdr->sq_tail, tail + nb, __ATOMIC_RELEASE);
+
+	memset(&enter, 0, sizeof(enter));
+	enter.to_submit = nb;
+	enter.min_complete = nb;
+	enter.flags = AKIDA_RING_ENTER_GETEVENTS;
+	if (flags & AKIDA_RING_SETUP_SQPOLL) {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		if (__atomic_load_n(&ring->hdr->sq_flags, __ATOMIC_RELAXED) &
+		    AKIDA_RING_SQ_NEED_WAKEUP)
+			enter.flags |= AKIDA_RING_ENTER_SQ_WAKEUP;
+	}
+	if (ioctl(fd, AKIDA_IOCTL_RING_ENTER, &enter) < 0) {
+		err = errno;
+		fprintf(stderr,"ioctl(AKIDA_IOCTL_RING_ENTER) failed (%d-%s)\n",
+			err, strerror(err));
+		return err;
+	}
+
+	head = ring->hdr->cq_head;
+	for (done = 0; done < nb; done++) {
+		if (__atomic_load_n(&ring->hdr->cq_tail, __ATOMIC_ACQUIRE) == head + done) {
+			fprintf(stderr,"missing completions (%u/%u)\n", done, nb);
+			return ECANCELED;
+		}
+		cqe = &ring->cqes[(head + done) & ring->hdr->cq_mask];
+		if (cqe->res != (int32_t)size) {
+			fprintf(stderr,"transfer %"PRIu64" returns %d\n",
+				(uint64_t)cqe->user_data, cqe->res);
+			return ECANCELED;
+		}
+	}
+	__atomic_store_n(&ring->hdr->cq_head, head + nb, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static int test12(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Transfers through the submission and completion rings, consumed by
+	 * AKIDA_IOCTL_RING_ENTER then by the kernel polling thread.
+	 */
+#define TEST12_NB_XFER 8
+#define TEST12_XFER_SIZE 4096
+	static const uint32_t tab_flags[] = {0, AKIDA_RING_SETUP_SQPOLL};
+	struct akida_ring_params params;
+	struct test12_ring ring;
+	uint8_t *buff[2];
+	unsigned int i;
+	size_t total;
+	size_t size;
+	int ring_fd;
+	int err;
+
+	total = TEST12_NB_XFER * TEST12_XFER_SIZE;
+	err = posix_memalign((void **)&buff[0], 4096, total);
+	if (err)
+		return err;
+	err = posix_memalign((void **)&buff[1], 4096, total);
+	if (err) {
+		free(buff[0]);
+		return err;
+	}
+
+	for (i = 0; i < sizeof(tab_flags)/sizeof(tab_flags[0]); i++) {
+		for (size = 0; size < total; size++)
+			buff[0][size] = size * 13 + i;
+		memset(buff[1], 0, total);
+
+		/* A ring is set up once per open file */
+		ring_fd = open(devpath, O_RDWR);
+		if (ring_fd < 0) {
+			err = errno;
+			fprintf(stderr,"open(%s) failed (%d-%s)\n",
+				devpath, err, strerror(err));
+			goto end;
+		}
+
+		memset(&params, 0, sizeof(params));
+		params.sq_entries = TEST12_NB_XFER;
+		params.flags = tab_flags[i];
+		if (ioctl(ring_fd, AKIDA_IOCTL_RING_SETUP, &params) < 0) {
+			err = errno;
+			close(ring_fd);
+			if (err == EPERM && (params.flags & AKIDA_RING_SETUP_SQPOLL)) {
+				/* Polling thread requires CAP_SYS_NICE */
+				printf("SQPOLL not permitted, skipped\n");
+				err = 0;
+				continue;
+			}
+			fprintf(stderr,"ioctl(AKIDA_IOCTL_RING_SETUP) failed (%d-%s)\n",
+				err, strerror(err));
+			goto end;
+		}
+
+		ring.size = params.size;
+		ring.hdr = mmap(NULL, ring.size, PROT_READ | PROT_WRITE,
+				MAP_SHARED, ring_fd, AKIDA_RING_MMAP_OFFSET);
+		if (ring.hdr == MAP_FAILED) {
+			err = errno;
+			fprintf(stderr,"mmap(ring) failed (%d-%s)\n",
+				err, strerror(err));
+			close(ring_fd);
+			goto end;
+		}
+		ring.sqes = (void *)((uint8_t *)ring.hdr + ring.hdr->sqes_off);
+		ring.cqes = (void *)((uint8_t *)ring.hdr + ring.hdr->cqes_off);
+
+		err = test12_run(ring_fd, &ring, params.flags, buff[0],
+				 TEST12_XFER_SIZE, TEST12_NB_XFER,
+				 AKIDA_XFER_TO_DEV, test_area);
+		if (!err)
+			err = test12_run(ring_fd, &ring, params.flags, buff[1],
+					 TEST12_XFER_SIZE, TEST12_NB_XFER,
+					 AKIDA_XFER_FROM_DEV, test_area);
+		munmap(ring.hdr, ring.size);
+		close(ring_fd);
+		if (err)
+			goto end;
+
+		if (memcmp(buff[0], buff[1], total)) {
+			printf("Mismatch (%s)\n", i ? "sqpoll" : "enter");
+			err = EILSEQ;
+			goto end;
+		}
+		if (is_verbose)
+			printf("Wr/Rd @0x%04lx, %d x %d bytes (%s), data ok\n",
+				test_area, TEST12_NB_XFER, TEST12_XFER_SIZE,
+				i ? "sqpoll" : "enter");
+	}
+
+end:
+	free(buff[1]);
+	free(buff[0]);
+	return err;
+}
+
+static int test13(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Polled transfers (RWF_HIPRI): small ones through the bounce buffers
+	 * and a larger one in zero-copy.
+	 */
+	static const size_t tab_size[] = {4, 100, 4096, 64*1024};
+	struct iovec iov[2];
+	uint8_t *buff[2];
+	ssize_t ssize;
+	unsigned int i;
+	size_t size;
+	int err;
+
+	err = posix_memalign((void **)&buff[0], 4096, 64*1024);
+	if (err) {
+		fprintf(stderr,"posix_memalign(%d) failed (%d-%s)\n",
+			64*1024, err, strerror(err));
+		return err;
+	}
+	err = posix_memalign((void **)&buff[1], 4096, 64*1024);
+	if (err) {
+		fprintf(stderr,"posix_memalign(%d) failed (%d-%s)\n",
+			64*1024, err, strerror(err));
+		free(buff[0]);
+		return err;
+	}
+
+	for (i = 0; i < sizeof(tab_size)/sizeof(tab_size[0]); i++) {
+		for (size = 0; size < tab_size[i]; size++)
+			buff[0][size] = size * 13 + i;
+		memset(buff[1], 0, tab_size[i]);
+
+		iov[0].iov_base = buff[0];
+		iov[0].iov_len = tab_size[i];
+		iov[1].iov_base = buff[1];
+		iov[1].iov_len = tab_size[i];
+
+		ssize = pwritev2(fd, &iov[0], 1, test_area, RWF_HIPRI);
+		if (ssize != (ssize_t)tab_size[i]) {
+			err = ssize < 0 ? errno : ECANCELED;
+			fprintf(stderr,"pwritev2(%zu,0x%lx,RWF_HIPRI) failed (%d-%s)\n",
+				tab_size[i], test_area, err, strerror(err));
+			goto end;
+		}
+
+		ssize = preadv2(fd, &iov[1], 1, test_area, RWF_HIPRI);
+		if (ssize != (ssize_t)tab_size[i]) {
+			err = ssize < 0 ? errno : ECANCELED;
+			fprintf(stderr,"preadv2(%zu,0x%lx,RWF_HIPRI) failed (%d-%s)\n",
+				tab_size[i], test_area, err, strerror(err));
+			goto end;
+		}
+
+		if (memcmp(buff[0], buff[1], tab_size[i])) {
+			printf("Mismatch (%zu bytes)\n", tab_size[i]);
+			err = EILSEQ;
+			goto end;
+		}
+		if (is_verbose)
+			printf("Wr/Rd @0x%04lx, %zu bytes polled, data ok\n",
+				test_area, tab_size[i]);
+	}
+
+end:
+	free(buff[1]);
+	free(buff[0]);
+	return err;
+}
+
+static int test14(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Small accesses by programmed I/O (below pio_max in sysfs) checked
+	 * against DMA accesses (above pio_max) of the same area, and the mean
+	 * latency of a 4 bytes access.
+	 */
+#define TEST14_PIO_SIZE 16
+#define TEST14_DMA_SIZE 4096
+#define TEST14_NB_LOOP 1000
+	struct timespec tstart, tend;
+	uint8_t *buff[2];
+	ssize_t ssize;
+	size_t off;
+	size_t size;
+	int err;
+	int i;
+
+	/* The page of the DMA controller area is not mapped for programmed
+	 * I/O, use the next one.
+	 */
+	test_area = (test_area & ~(off_t)4095) + 4096;
+
+	err = posix_memalign((void **)&buff[0], 4096, TEST14_DMA_SIZE);
+	if (err) {
+		fprintf(stderr,"posix_memalign(%d) failed (%d-%s)\n",
+			TEST14_DMA_SIZE, err, strerror(err));
+		return err;
+	}
+	err = posix_memalign((void **)&buff[1], 4096, TEST14_DMA_SIZE);
+	if (err) {
+		fprintf(stderr,"posix_memalign(%d) failed (%d-%s)\n",
+			TEST14_DMA_SIZE, err, strerror(err));
+		free(buff[0]);
+		return err;
+	}
+
+	/* Small writes, large read */
+	for (size = 0; size < TEST14_DMA_SIZE; size++)
+		buff[0][size] = size * 7;
+	for (off = 0; off < TEST14_DMA_SIZE; off += TEST14_PIO_SIZE) {
+		ssize = pwrite(fd, buff[0] + off, TEST14_PIO_SIZE, test_area + off);
+		if (ssize != TEST14_PIO_SIZE) {
+			err = ssize < 0 ? errno : ECANCELED;
+			fprintf(stderr,"pwrite(%d,0x%lx) failed (%d-%s)\n",
+				TEST14_PIO_SIZE, test_area + off, err, strerror(err));
+			goto end;
+		}
+	}
+	ssize = pread(fd, buff[1], TEST14_DMA_SIZE, test_area);
+	if (ssize != TEST14_DMA_SIZE) {
+		err = ssize < 0 ? errno : ECANCELED;
+		fprintf(stderr,"pread(%d,0x%lx) failed (%d-%s)\n",
+			TEST14_DMA_SIZE, test_area, err, strerror(err));
+		goto end;
+	}
+	if (memcmp(buff[0], buff[1], TEST14_DMA_SIZE)) {
+		printf("Mismatch (small writes, large read)\n");
+		err = EILSEQ;
+		goto end;
+	}
+
+	/* Large write, small reads */
+	for (size = 0; size < TEST14_DMA_SIZE; size++)
+		buff[0][size] = size * 3 + 1;
+	memset(buff[1], 0, TEST14_DMA_SIZE);
+	ssize = pwrite(fd, buff[0], TEST14_DMA_SIZE, test_area);
+	if (ssize != TEST14_DMA_SIZE) {
+		err = ssize < 0 ? errno : ECANCELED;
+		fprintf(stderr,"pwrite(%d,0x%lx) failed (%d-%s)\n",
+			TEST14_DMA_SIZE, test_area, err, strerror(err));
+		goto end;
+	}
+	for (off = 0; off < TEST14_DMA_SIZE; off += TEST14_PIO_SIZE) {
+		ssize = pread(fd, buff[1] + off, TEST14_PIO_SIZE, test_area + off);
+		if (ssize != TEST14_PIO_SIZE) {
+			err = ssize < 0 ? errno : ECANCELED;
+			fprintf(stderr,"pread(%d,0x%lx) failed (%d-%s)\n",
+				TEST14_PIO_SIZE, test_area + off, err, strerror(err));
+			goto end;
+		}
+	}
+	if (memcmp(buff[0], buff[1], TEST14_DMA_SIZE)) {
+		printf("Mismatch (large write, small reads)\n");
+		err = EILSEQ;
+		goto end;
+	}
+	if (is_verbose)
+		printf("Wr/Rd @0x%04lx, %d bytes by %d bytes accesses, data ok\n",
+			test_area, TEST14_DMA_SIZE, TEST14_PIO_SIZE);
+
+	clock_gettime(CLOCK_MONOTONIC, &tstart);
+	for (i = 0; i < TEST14_NB_LOOP; i++) {
+		ssize = pread(fd, buff[1], 4, test_area);
+		if (ssize != 4) {
+			err = ssize < 0 ? errno : ECANCELED;
+			fprintf(stderr,"pread(4,0x%lx) failed (%d-%s)\n",
+				test_area, err, strerror(err));
+			goto end;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &tend);
+	if (is_verbose)
+		printf("Rd @0x%04lx, 4 bytes: %.2f us\n", test_area,
+			elapsed_sec(&tstart, &tend) * 1e6 / TEST14_NB_LOOP);
+
+end:
+	free(buff[1]);
+	free(buff[0]);
+	return err;
+}
+
+static int test15(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Export a slice of the host DDR area as a dma-buf, then import it
+	 * to transfer data between the dma-buf and the device.
+	 */
+#define TEST15_SIZE (64*1024)
+	struct akida_dmabuf_export exp;
+	struct akida_dmabuf_xfer xfer;
+	uint8_t *buff;
+	uint8_t *map;
+	size_t size;
+	int err;
+
+	memset(&exp, 0, sizeof(exp));
+	exp.offset = 0;
+	exp.size = TEST15_SIZE;
+	exp.flags = O_CLOEXEC | O_RDWR;
+	if (ioctl(fd, AKIDA_IOCTL_DMABUF_EXPORT, &exp) < 0) {
+		err = errno;
+		if (err == ENODEV) {
+			printf("No host DDR area, skipped\n");
+			return 0;
+		}
+		fprintf(stderr,"AKIDA_IOCTL_DMABUF_EXPORT failed (%d-%s)\n",
+			err, strerror(err));
+		return err;
+	}
+
+	buff = malloc(TEST15_SIZE);
+	if (!buff) {
+		close(exp.fd);
+		return ENOMEM;
+	}
+
+	map = mmap(NULL, TEST15_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   exp.fd, 0);
+	if (map == MAP_FAILED) {
+		err = errno;
+		fprintf(stderr,"mmap(dma-buf) failed (%d-%s)\n", err, strerror(err));
+		goto end;
+	}
+
+	/* dma-buf to device */
+	for (size = 0; size < TEST15_SIZE; size++)
+		map[size] = size * 17;
+	memset(&xfer, 0, sizeof(xfer));
+	xfer.fd = exp.fd;
+	xfer.dir = AKIDA_XFER_TO_DEV;
+	xfer.offset = 0;
+	xfer.len = TEST15_SIZE;
+	xfer.dev_addr = test_area;
+	if (ioctl(fd, AKIDA_IOCTL_DMABUF_XFER, &xfer) < 0) {
+		err = errno;
+		fprintf(stderr,"AKIDA_IOCTL_DMABUF_XFER(to dev) failed (%d-%s)\n",
+			err, strerror(err));
+		goto unmap;
+	}
+	if (pread(fd, buff, TEST15_SIZE, test_area) != TEST15_SIZE) {
+		err = errno ? errno : ECANCELED;
+		fprintf(stderr,"pread(%d,0x%lx) failed (%d-%s)\n",
+			TEST15_SIZE, test_area, err, strerror(err));
+		goto unmap;
+	}
+	if (memcmp(map, buff, TEST15_SIZE)) {
+		printf("Mismatch (dma-buf to device)\n");
+		err = EILSEQ;
+		goto unmap;
+	}
+
+	/* Device to dma-buf */
+	memset(map, 0, TEST15_SIZE);
+	xfer.dir = AKIDA_XFER_FROM_DEV;
+	if (ioctl(fd, AKIDA_IOCTL_DMABUF_XFER, &xfer) < 0) {
+		err = errno;
+		fprintf(stderr,"AKIDA_IOCTL_DMABUF_XFER(from dev) failed (%d-%s)\n",
+			err, strerror(err));
+		goto unmap;
+	}
+	if (memcmp(map, buff, TEST15_SIZE)) {
+		printf("Mismatch (device to dma-buf)\n");
+		err = EILSEQ;
+		goto unmap;
+	}
+
+	err = 0;
+	if (is_verbose)
+		printf("Wr/Rd @0x%04lx, %d bytes from/to dma-buf, data ok\n",
+			test_area, TEST15_SIZE);
+
+unmap:
+	munmap(map, TEST15_SIZE);
+end:
+	free(buff);
+	close(exp.fd);
+	return err;
+}
+
+static int test16_xfer(int fd, struct akida_xfer *xfer)
+{
+	struct akida_xfer_list list;
+
+	list.xfers = (uintptr_t)xfer;
+	list.nr_xfers = 1;
+	list.flags = 0;
+	errno = 0;
+	if (ioctl(fd, AKIDA_IOCTL_XFER, &list) < 0 || xfer->status)
+		return errno ? errno : ECANCELED;
+	return 0;
+}
+
+static int test16(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Register a buffer, then transfer parts of it, small and large,
+	 * with transfer lists selecting it by its index.
+	 */
+#define TEST16_SIZE (256*1024)
+#define TEST16_LARGE_SIZE (64*1024)
+#define TEST16_SMALL_SIZE 100
+	struct akida_buf_unregister unreg;
+	struct akida_buf_register reg;
+	struct akida_xfer xfer[2];
+	struct akida_buf buf;
+	uint8_t *buff;
+	size_t size;
+	int err;
+
+	err = posix_memalign((void **)&buff, 4096, TEST16_SIZE);
+	if (err) {
+		fprintf(stderr,"posix_memalign(%d) failed (%d-%s)\n",
+			TEST16_SIZE, err, strerror(err));
+		return err;
+	}
+	for (size = 0; size < TEST16_SIZE / 2; size++)
+		buff[size] = size * 13;
+	memset(buff + TEST16_SIZE / 2, 0, TEST16_SIZE / 2);
+
+	buf.addr = (uintptr_t)buff;
+	buf.len = TEST16_SIZE;
+	reg.bufs = (uintptr_t)&buf;
+	reg.nr_bufs = 1;
+	reg.index = ~0U;
+	if (ioctl(fd, AKIDA_IOCTL_BUF_REGISTER, &reg) < 0) {
+		err = errno;
+		fprintf(stderr,"AKIDA_IOCTL_BUF_REGISTER failed (%d-%s)\n",
+			err, strerror(err));
+		goto end;
+	}
+	if (is_verbose)
+		printf("Registered %d bytes at index %u\n", TEST16_SIZE, reg.index);
+
+	/* Large transfers from the first half, to the second half, then small
+	 * ones, not cache line aligned. user_addr is the offset in the
+	 * registered buffer.
+	 */
+	xfer[0].dev_addr = test_area;
+	xfer[0].user_addr = 0;
+	xfer[0].len = TEST16_LARGE_SIZE;
+	xfer[0].dir = AKIDA_XFER_TO_DEV;
+	xfer[0].status = 1;
+	xfer[0].flags = AKIDA_XFER_FIXED_BUF;
+	xfer[0].buf_index = reg.index;
+	xfer[1] = xfer[0];
+	xfer[1].user_addr += TEST16_SIZE / 2;
+	xfer[1].dir = AKIDA_XFER_FROM_DEV;
+	for (size = 0; size < 4; size++) {
+		if (size == 2) {
+			xfer[0].dev_addr += TEST16_LARGE_SIZE;
+			xfer[0].user_addr += TEST16_LARGE_SIZE + 4;
+			xfer[0].len = TEST16_SMALL_SIZE;
+			xfer[1].dev_addr = xfer[0].dev_addr;
+			xfer[1].user_addr = xfer[0].user_addr + TEST16_SIZE / 2;
+			xfer[1].len = TEST16_SMALL_SIZE;
+		}
+		err = test16_xfer(fd, &xfer[size % 2]);
+		if (err) {
+			fprintf(stderr,"ioctl(AKIDA_IOCTL_XFER) failed (%d-%s)\n",
+				err, strerror(err));
+			goto unregister;
+		}
+	}
+
+	if (memcmp(buff, buff + TEST16_SIZE / 2, TEST16_LARGE_SIZE) ||
+	    memcmp(buff + TEST16_LARGE_SIZE + 4,
+		   buff + TEST16_SIZE / 2 + TEST16_LARGE_SIZE + 4,
+		   TEST16_SMALL_SIZE)) {
+		printf("Mismatch\n");
+		err = EILSEQ;
+		goto unregister;
+	}
+	if (is_verbose)
+		printf("Wr/Rd @0x%04lx, %d + %d bytes, data ok\n", test_area,
+			TEST16_LARGE_SIZE, TEST16_SMALL_SIZE);
+
+	/* Beyond the end of the registered buffer */
+	xfer[1].user_addr = TEST16_SIZE - TEST16_SMALL_SIZE / 2;
+	xfer[1].status = 1;
+	if (test16_xfer(fd, &xfer[1]) != EINVAL) {
+		fprintf(stderr,"Out of bounds registered buffer transfer not rejected\n");
+		err = ECANCELED;
+	}
+
+unregister:
+	unreg.index = reg.index;
+	unreg.nr_bufs = 1;
+	if (ioctl(fd, AKIDA_IOCTL_BUF_UNREGISTER, &unreg) < 0 && !err) {
+		err = errno;
+		fprintf(stderr,"AKIDA_IOCTL_BUF_UNREGISTER failed (%d-%s)\n",
+			err, strerror(err));
+	}
+	/* Already unregistered */
+	if (!err && ioctl(fd, AKIDA_IOCTL_BUF_UNREGISTER, &unreg) == 0) {
+		fprintf(stderr,"AKIDA_IOCTL_BUF_UNREGISTER succeeded twice\n");
+		err = ECANCELED;
+	}
+end:
+	free(buff);
+	return err;
+}
+
+static int test17(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Bind a channel of each direction, transfer on them, then unbind */
+	static const size_t tab_size[] = {100, 4096, 64*1024};
+	struct akida_chan_bind bind;
+	int err, err2;
+
+	bind.flags = AKIDA_CHAN_BIND_RX | AKIDA_CHAN_BIND_TX;
+	if (ioctl(fd, AKIDA_IOCTL_CHAN_BIND, &bind) < 0) {
+		err = errno;
+		fprintf(stderr,"AKIDA_IOCTL_CHAN_BIND failed (%d-%s)\n",
+			err, strerror(err));
+		return err;
+	}
+
+	err = test10_rw(fd, is_verbose, tab_size,
+			sizeof(tab_size) / sizeof(tab_size[0]), test_area);
+
+	bind.flags = 0;
+	if (ioctl(fd, AKIDA_IOCTL_CHAN_BIND, &bind) < 0) {
+		err2 = errno;
+		fprintf(stderr,"AKIDA_IOCTL_CHAN_BIND(unbind) failed (%d-%s)\n",
+			err2, strerror(err2));
+		if (!err)
+			err = err2;
+	}
+	return err;
+}
+
+struct test18_bulk {
+	int fd;
+	off_t test_area;
+	volatile int stop;
+	int err;
+};
+
+static void *test18_bulk_fct(void *arg)
+{
+	struct test18_bulk *b = arg;
+	uint8_t *buff;
+	ssize_t ssize;
+
+	b->err = posix_memalign((void **)&buff, 4096, TEST8_BUFFER_SIZE);
+	if (b->err)
+		return NULL;
+	memset(buff, 0x5a, TEST8_BUFFER_SIZE);
+
+	while (!b->stop) {
+		ssize = pwrite(b->fd, buff, TEST8_BUFFER_SIZE, b->test_area);
+		if (ssize != TEST8_BUFFER_SIZE) {
+			b->err = ssize < 0 ? errno : ECANCELED;
+			break;
+		}
+	}
+
+	free(buff);
+	return NULL;
+}
+
+static int test18(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Latency class transfers while a bulk class one runs in another
+	 * file: report their mean and max time.
+	 */
+#define TEST18_SIZE 4096
+#define TEST18_NB_LOOP 256
+	struct timespec tstart, tend;
+	struct akida_set_qos qos;
+	struct test18_bulk bulk;
+	uint8_t buff[2][TEST18_SIZE];
+	pthread_t thread_id;
+	double us, us_max, us_sum;
+	unsigned int loop;
+	ssize_t ssize;
+	size_t size;
+	int err, err2;
+
+	bulk.fd = open(devpath, O_RDWR);
+	if (bulk.fd < 0) {
+		err = errno;
+		fprintf(stderr,"open(%s) failed (%d-%s)\n",
+			devpath, err, strerror(err));
+		return err;
+	}
+	bulk.test_area = test_area + TEST18_SIZE;
+	bulk.stop = 0;
+	bulk.err = 0;
+
+	qos.qos_class = AKIDA_QOS_LATENCY;
+	qos.flags = 0;
+	if (ioctl(fd, AKIDA_IOCTL_SET_QOS, &qos) < 0) {
+		err = errno;
+		fprintf(stderr,"AKIDA_IOCTL_SET_QOS failed (%d-%s)\n",
+			err, strerror(err));
+		close(bulk.fd);
+		return err;
+	}
+
+	err = pthread_create(&thread_id, NULL, test18_bulk_fct, &bulk);
+	if (err) {
+		fprintf(stderr,"pthread_create failed (%d-%s)\n",
+			err, strerror(err));
+		goto restore;
+	}
+
+	us_max = 0;
+	us_sum = 0;
+	for (loop = 0; loop < TEST18_NB_LOOP; loop++) {
+		for (size = 0; size < TEST18_SIZE; size++)
+			buff[0][size] = size + loop;
+
+		clock_gettime(CLOCK_MONOTONIC, &tstart);
+		ssize = pwrite(fd, buff[0], TEST18_SIZE, test_area);
+		if (ssize == TEST18_SIZE)
+			ssize = pread(fd, buff[1], TEST18_SIZE, test_area);
+		clock_gettime(CLOCK_MONOTONIC, &tend);
+		if (ssize != TEST18_SIZE) {
+			err = ssize < 0 ? errno : ECANCELED;
+			fprintf(stderr,"pwrite/pread(%d,0x%lx) failed (%d-%s)\n",
+				TEST18_SIZE, test_area, err, strerror(err));
+			break;
+		}
+		if (memcmp(buff[0], buff[1], TEST18_SIZE)) {
+			printf("Mismatch at loop %u\n", loop);
+			err = EILSEQ;
+			break;
+		}
+
+		us = (tend.tv_sec - tstart.tv_sec) * 1e6 +
+		     (tend.tv_nsec - tstart.tv_nsec) / 1e3;
+		us_sum += us;
+		if (us > us_max)
+			us_max = us;
+	}
+
+	bulk.stop = 1;
+	err2 = pthread_join(thread_id, NULL);
+	if (!err)
+		err = err2 ? err2 : bulk.err;
+
+	if (!err && is_verbose)
+		printf("Wr+Rd %d bytes during bulk writes: mean %.1f us, max %.1f us\n",
+			TEST18_SIZE, us_sum / TEST18_NB_LOOP, us_max);
+
+restore:
+	qos.qos_class = AKIDA_QOS_BULK;
+	if (ioctl(fd, AKIDA_IOCTL_SET_QOS, &qos) < 0 && !err)
+		err = errno;
+	close(bulk.fd);
+	return err;
+}
+
+#define TEST20_SIZE (64*1024)
+
+/* Module parameter value, 0 if it can't be read */
+static unsigned long test_module_param(const char *name)
+{
+	char path[256];
+	char val[32];
+	unsigned long ret = 0;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/sys/module/akida_pcie/parameters/%s",
+		 name);
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+	if (fgets(val, sizeof(val), f))
+		ret = strtoul(val, NULL, 0);
+	fclose(f);
+	return ret;
+}
+
+static int test20_copy(int fd, off_t offset, off_t area, size_t size,
+		       const uint8_t *buff, double *sec)
+{
+	struct timespec tstart, tend;
+	uint8_t *map;
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+		   offset + area);
+	if (map == MAP_FAILED)
+		return errno;
+
+	clock_gettime(CLOCK_MONOTONIC, &tstart);
+	memcpy(map, buff, size);
+	/* Flush the write-combining buffers */
+	__sync_synchronize();
+	clock_gettime(CLOCK_MONOTONIC, &tend);
+	*sec = elapsed_sec(&tstart, &tend);
+
+	munmap(map, size);
+	return 0;
+}
+
+static int test20(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Write through a write-combining then an uncached mapping of the
+	 * DMA RAM, check the data and check that write-combining is faster.
+	 * The write-combining part (dma_ram_wc_size module parameter) starts
+	 * at the page after the DMA controller area, the uncached one is
+	 * taken after it.
+	 */
+	uint8_t buff[2][TEST20_SIZE];
+	long page = sysconf(_SC_PAGESIZE);
+	off_t wc_area, uc_area;
+	double sec_uc, sec_wc;
+	size_t wc_size, size, i;
+	int err;
+
+	wc_size = test_module_param("dma_ram_wc_size");
+	wc_size = (wc_size + page - 1) & ~(size_t)(page - 1);
+	if (!wc_size) {
+		printf("No write-combining mapping, skipped\n");
+		return 0;
+	}
+	size = wc_size < TEST20_SIZE ? wc_size : TEST20_SIZE;
+	wc_area = (test_area & ~(off_t)(page - 1)) + page;
+	uc_area = wc_area + wc_size;
+
+	for (i = 0; i < size; i++)
+		buff[0][i] = i * 13;
+	err = test20_copy(fd, AKIDA_MMAP_WC_OFFSET, wc_area, size, buff[0],
+			  &sec_wc);
+	if (err == EINVAL) {
+		printf("No write-combining mapping, skipped\n");
+		return 0;
+	}
+	if (err) {
+		fprintf(stderr,"mmap(wc, 0x%lx) failed (%d-%s)\n",
+			wc_area, err, strerror(err));
+		return err;
+	}
+
+	if (pread(fd, buff[1], size, wc_area) != (ssize_t)size) {
+		err = errno ? errno : ECANCELED;
+		fprintf(stderr,"pread(%zu,0x%lx) failed (%d-%s)\n",
+			size, wc_area, err, strerror(err));
+		return err;
+	}
+	if (memcmp(buff[0], buff[1], size)) {
+		printf("Mismatch (write-combining mapping)\n");
+		return EILSEQ;
+	}
+
+	err = test20_copy(fd, 0, uc_area, size, buff[0], &sec_uc);
+	if (err) {
+		fprintf(stderr,"mmap(0x%lx) failed (%d-%s)\n",
+			uc_area, err, strerror(err));
+		return err;
+	}
+
+	if (is_verbose)
+		printf("Wr %zu bytes by mmap: write-combining @0x%04lx %.1f us, uncached @0x%04lx %.1f us, data ok\n",
+			size, wc_area, sec_wc * 1e6, uc_area, sec_uc * 1e6);
+
+	/* A mapping silently downgraded to uncached runs at the same speed */
+	if (sec_wc >= sec_uc) {
+		printf("Write-combining mapping not faster than uncached (%.1f us, %.1f us)\n",
+			sec_wc * 1e6, sec_uc * 1e6);
+		return ECANCELED;
+	}
+	return 0;
+}
+
+/* Transfer expected to be rejected by the driver */
+static int test21_xfer(int fd, uint64_t dev_addr, uint64_t len, void *buff)
+{
+	struct akida_xfer_list list;
+	struct akida_xfer xfer;
+	int err;
+
+	xfer.dev_addr = dev_addr;
+	xfer.user_addr = (uintptr_t)buff;
+	xfer.len = len;
+	xfer.dir = AKIDA_XFER_FROM_DEV;
+	xfer.status = 1;
+	xfer.flags = 0;
+	xfer.buf_index = 0;
+
+	list.xfers = (uintptr_t)&xfer;
+	list.nr_xfers = 1;
+	list.flags = 0;
+	if (ioctl(fd, AKIDA_IOCTL_XFER, &list) == 0) {
+		fprintf(stderr,"xfer @0x%"PRIx64", %"PRIu64" bytes not rejected\n",
+			dev_addr, len);
+		return ECANCELED;
+	}
+	err = errno;
+	if (err != EINVAL && err != EPERM) {
+		fprintf(stderr,"xfer @0x%"PRIx64", %"PRIu64" bytes failed (%d-%s)\n",
+			dev_addr, len, err, strerror(err));
+		return err;
+	}
+
+	return 0;
+}
+
+/* Whether the device is an AKD1500 */
+static int test_is_akd1500(const char *devpath)
+{
+	const char *name = strrchr(devpath, '/');
+	char path[256];
+	char val[32];
+	FILE *f;
+	int ok;
+
+	snprintf(path, sizeof(path), "/sys/class/misc/%s/device/device",
+		 name ? name + 1 : devpath);
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+	ok = fgets(val, sizeof(val), f) && !strncmp(val, "0xa500", 6);
+	fclose(f);
+	return ok;
+}
+
+static int test21(int fd, int is_verbose, const char *devpath, off_t test_area)
+{
+	/* Transfers outside of the 32-bit device address space, or wrapping
+	 * around it, are rejected, as well as the ones over the DMA
+	 * linked-lists in host memory and, on AKD1500, the ones to the
+	 * windows address space out of a window of the file.
+	 */
+	uint8_t buff[64];
+	int err;
+
+	err = test21_xfer(fd, 0x100000000ULL, sizeof(buff), buff);
+	if (!err)
+		err = test21_xfer(fd, 0xfffffff0ULL, sizeof(buff), buff);
+	if (!err)
+		err = test21_xfer(fd, UINT64_MAX - 0xf, sizeof(buff), buff);
+	if (!err && pread(fd, buff, sizeof(buff), 0xfffffff0) >= 0) {
+		fprintf(stderr,"pread(0xfffffff0) not rejected\n");
+		err = ECANCELED;
+	}
+	if (err)
+		return err;
+
+	/* Nor the DMA linked-lists in host memory */
+	if (test_is_akd1500(devpath) && test_module_param("ll_host_size")) {
+		err = test21_xfer(fd, 0xe0000000, sizeof(buff), buff);
+		if (!err && pwrite(fd, buff, sizeof(buff), 0xe0000000) >= 0) {
+			fprintf(stderr,"pwrite(0xe0000000) not rejected\n");
+			err = ECANCELED;
+		}
+		if (err)
+			return err;
+	} else if (is_verbose) {
+		printf("No DMA linked-lists in host memory, not checked\n");
+	}
+
+	/* Nor the windows address space, no window being mapped */
+	if (test_is_akd1500(devpath)) {
+		err = test21_xfer(fd, AKIDA_WIN_DEV_BASE, sizeof(buff), buff);
+		if (!err && pread(fd, buff, sizeof(buff), AKIDA_WIN_DEV_BASE) >= 0) {
+			fprintf(stderr,"pread(0x%x) not rejected\n",
+				AKIDA_WIN_DEV_BASE);
+			err = ECANCELED;
+		}
+		if (err)
+			return err;
+	}
+
+	if (is_verbose)
+		printf("Out of range transfers rejected\n");
+	return 0;
+}
+
 int main(int argc, char* argv[])
 {
 	const struct test_def {
@@ -369,6 +1703,20 @@ int main(int argc, char* argv[])
 		{"test5", test5},
 		{"test6", test6},
 		{"test7", test7},
+		{"test8", test8},
+		{"test9", test9},
+		{"test10", test10},
+		{"test11", test11},
+		{"test12", test12},
+		{"test13", test13},
+		{"test14", test14},
+		{"test15", test15},
+		{"test16", test16},
+		{"test17", test17},
+		{"test18", test18},
+		{"test19", test19},
+		{"test20", test20},
+		{"test21", test21},
 		{0}
 	}, *test;
 	const char *devpath;
@@ -6,10 +6,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
 #include <sys/mman.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "akida-pcie.h"
 #include "spdk/barrier.h"
 
 #define barrier_rmb	spdk_rmb
@@ -20,6 +22,7 @@ struct mmap_area {
 	void *virt_addr;
 	uint32_t phy_addr;
 	size_t size;
+	int fd;
 };
 
 static int mmap_area_init(struct mmap_area *mmap_area, const char *devpath, uint32_t phy_addr, size_t size)
@@ -41,12 +44,15 @@ static int mmap_area_init(struct mmap_area *mmap_area, const char *devpath, uint
 	mmap_area->virt_addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
 			MAP_SHARED, fd, phy_addr);
 
-	close(fd);
-	if (mmap_area->virt_addr == MAP_FAILED)
-		return errno;
+	if (mmap_area->virt_addr == MAP_FAILED) {
+		err = errno;
+		close(fd);
+		return err;
+	}
 
 	mmap_area->phy_addr = phy_addr;
 	mmap_area->size = size;
+	mmap_area->fd = fd;
 
 	return 0;
 }
@@ -55,6 +61,30 @@ static void mmap_area_exit(struct mmap_area *mmap_area)
 {
 	/* unmap the area */
 	munmap(mmap_area->virt_addr, mmap_area->size);
+	close(mmap_area->fd);
+}
+
+/* Bracket the CPU accesses to the host DDR area, needed when the driver maps
+ * it cacheable (host_ddr_cached module parameter).
+ */
+static int mmap_area_sync(struct mmap_area *mmap_area, void *virt_addr,
+			  size_t size, uint32_t flags)
+{
+	struct akida_host_ddr_sync sync;
+	int err;
+
+	memset(&sync, 0, sizeof(sync));
+	sync.offset = (uint8_t *)virt_addr - (uint8_t *)mmap_area->virt_addr;
+	sync.size = size;
+	sync.flags = flags;
+	if (ioctl(mmap_area->fd, AKIDA_IOCTL_HOST_DDR_SYNC, &sync) < 0) {
+		err = errno;
+		fprintf(stderr,"AKIDA_IOCTL_HOST_DDR_SYNC(0x%x) failed (%d-%s)\n",
+			flags, err, strerror(err));
+		return err;
+	}
+
+	return 0;
 }
 
 static uint32_t mmap_area_virt2phy(struct mmap_area *mmap_area, void *virt_addr)
@@ -264,6 +294,10 @@ static enum test_result test_host_ddr_simple(struct mmap_area *ddr, struct mmap_
 		printf("   xfer size: %zu (0x%zx) bytes\n",
 			4 * sizeof(uint32_t), 4 * sizeof(uint32_t));
 
+	if (mmap_area_sync(ddr, desc, 0x2000 + (8 + 4) * sizeof(uint32_t),
+			   AKIDA_HOST_DDR_SYNC_START | AKIDA_HOST_DDR_SYNC_RW))
+		return TEST_FAILED;
+
 	timestamp_get(&tstart);
 
 	/* Initialize the source data */
@@ -282,6 +316,10 @@ static enum test_result test_host_ddr_simple(struct mmap_area *ddr, struct mmap_
 	desc->size = 4;
 	desc->dst  = mmap_area_virt2phy(ddr, data_dst);
 
+	if (mmap_area_sync(ddr, desc, 0x2000 + (8 + 4) * sizeof(uint32_t),
+			   AKIDA_HOST_DDR_SYNC_END | AKIDA_HOST_DDR_SYNC_RW))
+		return TEST_FAILED;
+
 	/* Initialize the DMA controller */
 	dma_init(dma, mmap_area_virt2phy(ddr, desc));
 
@@ -304,6 +342,10 @@ static enum test_result test_host_ddr_simple(struct mmap_area *ddr, struct mmap_
 
 	timestamp_get(&tstart);
 
+	if (mmap_area_sync(ddr, data_dst, (8 + 4) * sizeof(uint32_t),
+			   AKIDA_HOST_DDR_SYNC_START | AKIDA_HOST_DDR_SYNC_READ))
+		return TEST_FAILED;
+
 	/* Checked destination data */
 	for (count = 0; count < 4; count++) {
 		tmp = *(data_dst + 8 + count);
@@ -356,6 +398,10 @@ static enum test_result test_host_ddr_size(struct mmap_area *ddr, struct mmap_ar
 	if (is_verbose)
 		printf("   xfer size: %zu (0x%zx) bytes\n", data_size, data_size);
 
+	if (mmap_area_sync(ddr, desc, (data_size + 0x20) * 2,
+			   AKIDA_HOST_DDR_SYNC_START | AKIDA_HOST_DDR_SYNC_RW))
+		return TEST_FAILED;
+
 	timestamp_get(&tstart);
 
 	/* Initialize the source data */
@@ -375,6 +421,10 @@ static enum test_result test_host_ddr_size(struct mmap_area *ddr, struct mmap_ar
 	desc->size = data_size/sizeof(uint32_t);
 	desc->dst  = mmap_area_virt2phy(ddr, data_dst);
 
+	if (mmap_area_sync(ddr, desc, (data_size + 0x20) * 2,
+			   AKIDA_HOST_DDR_SYNC_END | AKIDA_HOST_DDR_SYNC_RW))
+		return TEST_FAILED;
+
 	/* Initialize the DMA controller */
 	dma_init(dma, mmap_area_virt2phy(ddr, desc));
 
@@ -397,6 +447,10 @@ static enum test_result test_host_ddr_size(struct mmap_area *ddr, struct mmap_ar
 
 	timestamp_get(&tstart);
 
+	if (mmap_area_sync(ddr, data_dst, 8 * sizeof(uint32_t) + data_size,
+			   AKIDA_HOST_DDR_SYNC_START | AKIDA_HOST_DDR_SYNC_READ))
+		return TEST_FAILED;
+
 	/* Checked destination data */
 	for (count = 0; count < data_size / sizeof(uint32_t); count++) {
 		read = *(data_dst + 8 + count);
@@ -415,6 +469,126 @@ static enum test_result test_host_ddr_size(struct mmap_area *ddr, struct mmap_ar
 	return TEST_OK;
 }
 
+/* DMA from the host DDR area to a huge page of the application, seen by the
+ * device at AKIDA_WIN_DEV_BASE through an outbound window.
+ */
+#define TEST_WIN_SIZE	(2*1024*1024)
+
+static enum test_result test_host_ddr_win(struct mmap_area *ddr, struct mmap_area *dma, int is_verbose, unsigned long param)
+{
+	struct akida_win_unmap win_unmap;
+	struct akida_win_map win_map;
+	enum test_result result;
+	struct dma_descriptor *desc;
+	uint32_t *data_src;
+	uint32_t *data_dst;
+	uint32_t read, exp;
+	size_t data_size;
+	size_t count;
+	int err;
+
+	data_size = param;
+	if (ddr->size < data_size + 0x20) {
+		printf("   min ddr size needed: %zu bytes\n", data_size + 0x20);
+		return TEST_NOTDONE;
+	}
+	if (8 * sizeof(uint32_t) + data_size > TEST_WIN_SIZE) {
+		printf("   max data size: %zu bytes\n",
+			TEST_WIN_SIZE - 8 * sizeof(uint32_t));
+		return TEST_NOTDONE;
+	}
+
+	/* A huge page is physically contiguous: one outbound region */
+	data_dst = mmap(NULL, TEST_WIN_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (data_dst == MAP_FAILED) {
+		err = errno;
+		printf("   no huge page (%d-%s)\n", err, strerror(err));
+		return TEST_NOTDONE;
+	}
+
+	/* Zeroize the destination data, faulting the page in */
+	memset(data_dst, 0, TEST_WIN_SIZE);
+
+	memset(&win_map, 0, sizeof(win_map));
+	win_map.addr = (uintptr_t)data_dst;
+	win_map.len = TEST_WIN_SIZE;
+	win_map.dev_addr = AKIDA_WIN_DEV_BASE;
+	if (ioctl(ddr->fd, AKIDA_IOCTL_WIN_MAP, &win_map) < 0) {
+		err = errno;
+		fprintf(stderr,"AKIDA_IOCTL_WIN_MAP failed (%d-%s)\n",
+			err, strerror(err));
+		munmap(data_dst, TEST_WIN_SIZE);
+		return TEST_FAILED;
+	}
+
+	desc = ddr->virt_addr;
+	data_src = ddr->virt_addr + 0x00000020;
+
+	/* AKD1500 DMA Reset, issued from RC */
+	dma_reset(dma);
+
+	if (is_verbose)
+		printf("   xfer size: %zu (0x%zx) bytes\n", data_size, data_size);
+
+	result = TEST_FAILED;
+	if (mmap_area_sync(ddr, desc, data_size + 0x20,
+			   AKIDA_HOST_DDR_SYNC_START | AKIDA_HOST_DDR_SYNC_WRITE))
+		goto unmap;
+
+	/* Initialize the source data */
+	for (count = 0; count < data_size/sizeof(uint32_t); count++)
+		*(data_src + count) = AKIDA_WIN_DEV_BASE + count;
+
+	/* Set the DMA descriptor */
+	desc->ctrl = 0;
+	desc->src  = mmap_area_virt2phy(ddr, data_src);
+	desc->size = data_size/sizeof(uint32_t);
+	desc->dst  = AKIDA_WIN_DEV_BASE;
+
+	if (mmap_area_sync(ddr, desc, data_size + 0x20,
+			   AKIDA_HOST_DDR_SYNC_END | AKIDA_HOST_DDR_SYNC_WRITE))
+		goto unmap;
+
+	/* Initialize the DMA controller */
+	dma_init(dma, mmap_area_virt2phy(ddr, desc));
+
+	/* Start the DMA with descriptor #0 */
+	dma_start(dma, 0);
+
+	/* Wait for the end of DMA */
+	err = dma_wait(dma, 1*1000*1000);
+	if (err) {
+		fprintf(stderr,"dma_wait() failed (%d-%s)\n",
+			err, strerror(err));
+		goto unmap;
+	}
+
+	/* Checked destination data, written in place by the device */
+	for (count = 0; count < data_size / sizeof(uint32_t); count++) {
+		read = *(data_dst + 8 + count);
+		exp = AKIDA_WIN_DEV_BASE + count;
+		if (read != exp) {
+			fprintf(stderr,"dest[%zu] = 0x%"PRIx32" != 0x%"PRIx32"\n",
+				count, read, exp);
+			goto unmap;
+		}
+	}
+	result = TEST_OK;
+
+unmap:
+	memset(&win_unmap, 0, sizeof(win_unmap));
+	win_unmap.index = win_map.index;
+	if (ioctl(ddr->fd, AKIDA_IOCTL_WIN_UNMAP, &win_unmap) < 0) {
+		err = errno;
+		fprintf(stderr,"AKIDA_IOCTL_WIN_UNMAP failed (%d-%s)\n",
+			err, strerror(err));
+		result = TEST_FAILED;
+	}
+	munmap(data_dst, TEST_WIN_SIZE);
+	return result;
+}
+
 static const char *test_result2str(enum test_result result)
 {
 	switch (result) {
@@ -471,6 +645,8 @@ static int do_tests(struct mmap_area *ddr, struct mmap_area *dma, struct tests_s
 		{ "test_host_ddr ~4MiB", test_host_ddr_size, 4*1024*1024 - 0x20 },
 		{ "test_host_ddr  4MiB", test_host_ddr_size, 4*1024*1024 },
 		{ "test_host_ddr ~8MiB", test_host_ddr_size, 8*1024*1024 - 0x20 },
+		{ "test_host_ddr win 4096", test_host_ddr_win, 4096 },
+		{ "test_host_ddr win  1MiB", test_host_ddr_win, 1*1024*1024 },
 		{ 0}
 	}, *test;
 	enum test_result result;